@@ -1,38 +1,124 @@
 #include "nori/c/c_api.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/strings/string_view.h"
 #include "nori/lib/dictionary/dictionary.h"
+#include "nori/lib/dictionary/registry.h"
 #include "nori/lib/tokenizer.h"
 
+// a reference of the dictionary shared by tokenizers in the process
+struct Dictionary_H {
+  std::shared_ptr<const nori::dictionary::Dictionary> dictionary;
+};
+
+struct LatticeHandle_H {
+  nori::Lattice lattice;
+  std::vector<FlatToken> tokens;
+  std::vector<TokenExpression> expressions;
+};
+
+namespace {
+
+// tokenize `length` bytes of str into `lattice`. It returns the status code of
+// the C API.
+int tokenizeLattice(const nori::NoriTokenizer* tokenizer, const char* str,
+                    size_t length, nori::Lattice& lattice) {
+  lattice.clear();
+  auto status =
+      lattice.setSentence(absl::string_view(str, length),
+                          tokenizer->getDictionary()->getNormalizer());
+  if (!status.ok()) {
+    return 1;
+  }
+
+  status = tokenizer->tokenize(lattice);
+  if (!status.ok()) {
+    return 2;
+  }
+  return 0;
+}
+
+// append tokens of the lattice except bos/eos. Expressions of the tokens are
+// appended to `expressions`, and they are pointed by linkExpressions.
+void appendTokens(const nori::Lattice& lattice, std::vector<FlatToken>& tokens,
+                  std::vector<TokenExpression>& expressions) {
+  const auto& ccTokens = *lattice.getTokens();
+  for (int i = 1; i < static_cast<int>(ccTokens.size()) - 1; i++) {
+    const auto& ccToken = ccTokens[i];
+    const auto* morpheme = ccToken.morpheme;
+    FlatToken token;
+    token.offset = ccToken.offset;
+    token.length = ccToken.length;
+    token.morphemeId = reinterpret_cast<uintptr_t>(morpheme);
+    token.leftId = morpheme->left_id();
+    token.rightId = morpheme->right_id();
+    token.wordCost = morpheme->word_cost();
+    token.posType = morpheme->pos_type();
+    token.posTag = morpheme->pos_tags().data();
+    token.posTagLength = morpheme->pos_tags_size();
+    token.expressions = nullptr;
+    token.exprLength = morpheme->expression_size();
+    tokens.push_back(token);
+
+    for (const auto& expression : morpheme->expression())
+      expressions.push_back(
+          {expression.surface().c_str(), expression.pos_tag()});
+  }
+}
+
+// point expressions of tokens in order.
+void linkExpressions(FlatToken* begin, FlatToken* end,
+                     const TokenExpression* expressions) {
+  for (auto* token = begin; token != end; token++) {
+    token->expressions = expressions;
+    expressions += token->exprLength;
+  }
+}
+
+size_t alignSize(size_t size) {
+  constexpr size_t kAlignment = alignof(std::max_align_t);
+  return (size + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+}  // namespace
+
 extern "C" {
 
 int initializeTokenizer(const char* dictionaryPath,
                         const char* userDictionaryPath,
                         Dictionary** dictionaryOutput,
                         Tokenizer** tokenizerOutput) {
-  nori::dictionary::Dictionary* dictionary = new nori::dictionary::Dictionary();
-  absl::Status status = dictionary->loadPrebuilt(std::string(dictionaryPath));
+  auto& registry = nori::dictionary::DictionaryRegistry::global();
+  Dictionary* dictionary = new Dictionary;
+  absl::Status status = registry.acquire(
+      dictionaryPath,
+      userDictionaryPath != NULL ? userDictionaryPath : "",
+      dictionary->dictionary);
   if (!status.ok()) {
     delete dictionary;
-    return 1;
+    return absl::IsInvalidArgument(status) ? 2 : 1;
   }
 
-  if (userDictionaryPath != NULL) {
-    status = dictionary->loadUser(std::string(userDictionaryPath));
-    if (!status.ok()) {
-      delete dictionary;
-      return 2;
-    }
-  }
-  nori::NoriTokenizer* tokenizer = new nori::NoriTokenizer(dictionary);
+  nori::NoriTokenizer* tokenizer =
+      new nori::NoriTokenizer(dictionary->dictionary.get());
   *tokenizerOutput = reinterpret_cast<Tokenizer*>(tokenizer);
-  *dictionaryOutput = reinterpret_cast<Dictionary*>(dictionary);
+  *dictionaryOutput = dictionary;
 
   return 0;
 }
 
 void freeTokenizer(const Dictionary* dictionary, const Tokenizer* tokenizer) {
-  delete reinterpret_cast<const nori::dictionary::Dictionary*>(dictionary);
   delete reinterpret_cast<const nori::NoriTokenizer*>(tokenizer);
+  delete dictionary;
 }
 
 int tokenize(const Tokenizer* rawTokenizer, const char* str,
@@ -40,7 +126,7 @@ int tokenize(const Tokenizer* rawTokenizer, const char* str,
   auto tokenizer = reinterpret_cast<const nori::NoriTokenizer*>(rawTokenizer);
   nori::Lattice lattice;
   auto status = lattice.setSentence(
-      std::string(str), tokenizer->getDictionary()->getNormalizer());
+      absl::string_view(str), tokenizer->getDictionary()->getNormalizer());
   if (!status.ok()) {
     return 1;
   }
@@ -108,4 +194,162 @@ void freeLattice(const Lattice* lattice) {
   delete[] lattice->sentence;
   delete lattice;
 }
+
+LatticeHandle* createLatticeHandle(void) { return new LatticeHandle; }
+
+void freeLatticeHandle(LatticeHandle* lattice) { delete lattice; }
+
+int tokenizeInto(const Tokenizer* rawTokenizer, const char* str, size_t length,
+                 LatticeHandle* handle, LatticeView* output) {
+  auto tokenizer = reinterpret_cast<const nori::NoriTokenizer*>(rawTokenizer);
+  auto& lattice = handle->lattice;
+  const int status = tokenizeLattice(tokenizer, str, length, lattice);
+  if (status != 0) {
+    return status;
+  }
+
+  handle->tokens.clear();
+  handle->expressions.clear();
+  appendTokens(lattice, handle->tokens, handle->expressions);
+  linkExpressions(handle->tokens.data(),
+                  handle->tokens.data() + handle->tokens.size(),
+                  handle->expressions.data());
+
+  output->sentence = lattice.getSentence().data();
+  output->sentenceLength = lattice.getSentence().size();
+  output->tokens = handle->tokens.data();
+  output->tokenLength = handle->tokens.size();
+  return 0;
+}
+
+int tokenizeBatch(const Tokenizer* rawTokenizer, const char** inputs,
+                  const size_t* lengths, size_t n, int numThreads,
+                  BatchResult** output) {
+  auto tokenizer = reinterpret_cast<const nori::NoriTokenizer*>(rawTokenizer);
+
+  // Each worker tokenizes inputs into its own buffers, and the results are
+  // copied into one buffer in the order of inputs.
+  struct WorkerOutput {
+    nori::Lattice lattice;
+    std::string sentences;
+    std::vector<FlatToken> tokens;
+    std::vector<TokenExpression> expressions;
+  };
+  struct ItemOutput {
+    int status;
+    int worker;
+    size_t sentenceBegin, sentenceLength;
+    size_t tokenBegin, tokenLength;
+    size_t expressionBegin, expressionLength;
+  };
+  if (numThreads <= 0)
+    numThreads =
+        std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  const int numWorkers = std::max<int>(1, std::min<size_t>(numThreads, n));
+  std::vector<WorkerOutput> workerOutputs(numWorkers);
+  std::vector<ItemOutput> itemOutputs(n);
+
+  std::atomic<size_t> next(0);
+  const auto worker = [&](int id) {
+    auto& workerOutput = workerOutputs[id];
+    for (size_t i; (i = next.fetch_add(1)) < n;) {
+      auto& item = itemOutputs[i];
+      item.worker = id;
+      item.status = tokenizeLattice(tokenizer, inputs[i], lengths[i],
+                                    workerOutput.lattice);
+      if (item.status != 0) continue;
+
+      const auto sentence = workerOutput.lattice.getSentence();
+      item.sentenceBegin = workerOutput.sentences.size();
+      item.sentenceLength = sentence.size();
+      workerOutput.sentences.append(sentence.data(), sentence.size());
+      workerOutput.sentences.push_back('\0');
+
+      item.tokenBegin = workerOutput.tokens.size();
+      item.expressionBegin = workerOutput.expressions.size();
+      appendTokens(workerOutput.lattice, workerOutput.tokens,
+                   workerOutput.expressions);
+      item.tokenLength = workerOutput.tokens.size() - item.tokenBegin;
+      item.expressionLength =
+          workerOutput.expressions.size() - item.expressionBegin;
+    }
+  };
+  std::vector<std::thread> workers;
+  for (int i = 1; i < numWorkers; i++) workers.emplace_back(worker, i);
+  worker(0);
+  for (auto& thread : workers) thread.join();
+
+  // layout: BatchResult, items, tokens, expressions and sentences
+  size_t numTokens = 0, numExpressions = 0, sentencesSize = 0;
+  for (const auto& workerOutput : workerOutputs) {
+    numTokens += workerOutput.tokens.size();
+    numExpressions += workerOutput.expressions.size();
+    sentencesSize += workerOutput.sentences.size();
+  }
+  const size_t itemsOffset = alignSize(sizeof(BatchResult));
+  const size_t tokensOffset = itemsOffset + alignSize(sizeof(BatchItem) * n);
+  const size_t expressionsOffset =
+      tokensOffset + alignSize(sizeof(FlatToken) * numTokens);
+  const size_t sentencesOffset =
+      expressionsOffset + alignSize(sizeof(TokenExpression) * numExpressions);
+  char* buffer =
+      static_cast<char*>(std::malloc(sentencesOffset + sentencesSize));
+  if (buffer == nullptr) {
+    *output = nullptr;
+    return 1;
+  }
+
+  auto* result = reinterpret_cast<BatchResult*>(buffer);
+  auto* items = reinterpret_cast<BatchItem*>(buffer + itemsOffset);
+  auto* tokens = reinterpret_cast<FlatToken*>(buffer + tokensOffset);
+  auto* expressions =
+      reinterpret_cast<TokenExpression*>(buffer + expressionsOffset);
+  char* sentences = buffer + sentencesOffset;
+  result->n = n;
+  result->items = items;
+
+  int status = 0;
+  for (size_t i = 0; i < n; i++) {
+    const auto& item = itemOutputs[i];
+    items[i].status = item.status;
+    if (item.status != 0) {
+      items[i].lattice = {nullptr, 0, nullptr, 0};
+      status = 1;
+      continue;
+    }
+
+    const auto& workerOutput = workerOutputs[item.worker];
+    // with the NULL terminator
+    std::copy_n(workerOutput.sentences.data() + item.sentenceBegin,
+                item.sentenceLength + 1, sentences);
+    std::copy_n(workerOutput.tokens.data() + item.tokenBegin,
+                item.tokenLength, tokens);
+    std::copy_n(workerOutput.expressions.data() + item.expressionBegin,
+                item.expressionLength, expressions);
+    linkExpressions(tokens, tokens + item.tokenLength, expressions);
+    items[i].lattice = {sentences, item.sentenceLength, tokens,
+                        static_cast<int>(item.tokenLength)};
+
+    sentences += item.sentenceLength + 1;
+    tokens += item.tokenLength;
+    expressions += item.expressionLength;
+  }
+
+  *output = result;
+  return status;
+}
+
+int tokenizeBatchBuffer(const Tokenizer* tokenizer, const char* buffer,
+                        const size_t* lengths, size_t n, int numThreads,
+                        BatchResult** output) {
+  std::vector<const char*> inputs(n);
+  for (size_t i = 0; i < n; i++) {
+    inputs[i] = buffer;
+    buffer += lengths[i];
+  }
+  return tokenizeBatch(tokenizer, inputs.data(), lengths, n, numThreads,
+                       output);
+}
+
+void freeBatchResult(BatchResult* result) { std::free(result); }
 }
@@ -35,6 +35,61 @@ typedef struct {
   int tokenLength;
 } Lattice;
 
+typedef struct LatticeHandle_H LatticeHandle;
+
+typedef struct {
+  // NULL-terminated surface owned by the dictionary
+  const char* surface;
+  int posTag;
+} TokenExpression;
+
+// Token of a lattice handle. posTag and expression surfaces point into the
+// dictionary, and expressions point into the lattice handle.
+typedef struct {
+  size_t offset;
+  size_t length;
+
+  // id of the morpheme. Tokens of the same morpheme have the same id, and ids
+  // are not reused by other morphemes until the tokenizer is freed, so
+  // bindings can cache per-morpheme values with it.
+  size_t morphemeId;
+  int leftId;
+  int rightId;
+  int wordCost;
+  int posType;
+  const int* posTag;
+  int posTagLength;
+
+  const TokenExpression* expressions;
+  int exprLength;
+} FlatToken;
+
+// Output of tokenizeInto. All pointers are owned by the lattice handle and
+// valid until the next tokenizeInto call with the handle or freeLatticeHandle.
+typedef struct {
+  const char* sentence;
+  size_t sentenceLength;
+  // tokens without BOS/EOS
+  const FlatToken* tokens;
+  int tokenLength;
+} LatticeView;
+
+typedef struct {
+  // 0 if tokenize succeed, 1 if normalization failed, or 2 if tokenizer cannot
+  // tokenize. lattice has NULL pointers unless status is 0.
+  int status;
+  // the sentence is NULL-terminated.
+  LatticeView lattice;
+} BatchItem;
+
+// Output of tokenizeBatch. The result and everything it points to, except
+// POS tags and expression surfaces owned by the dictionary, are in one
+// contiguous buffer.
+typedef struct {
+  size_t n;
+  const BatchItem* items;
+} BatchResult;
+
 // initialize using given dictionary path and user dictionary path.
 // set dictionary pointer in output.
 //
@@ -43,6 +98,8 @@ typedef struct {
 // * all path should be NULL-terminated.
 // * if userDictionaryPath is NULL, this function will skip loading user
 //   dictionary
+// * dictionaries are shared by tokenizers with the same paths in the process,
+//   and freed by freeTokenizer of the last one.
 int initializeTokenizer(const char* dictionaryPath,
                         const char* userDictionaryPath,
                         Dictionary** dictionaryOutput,
@@ -62,6 +119,43 @@ int tokenize(const Tokenizer* tokenizer, const char* str, Lattice** latticeOut);
 // free lattice resource
 void freeLattice(const Lattice* lattice);
 
+// create a lattice handle that can be reused by many tokenizeInto calls.
+// Token and expression buffers of the handle and the lattice buffers of the
+// tokenizer are kept between calls, so tokenizing into the same handle doesn't
+// allocate memory once the buffers are large enough.
+LatticeHandle* createLatticeHandle(void);
+
+// free lattice handle resources
+void freeLatticeHandle(LatticeHandle* lattice);
+
+// tokenize `length` bytes of str into the lattice handle, and set the tokens
+// to `output`. A lattice handle must not be used by many threads at once.
+//
+// This function will return 0 if tokenize succeed, 1 if normalization failed,
+// or 2 if tokenizer cannot tokenize.
+int tokenizeInto(const Tokenizer* tokenizer, const char* str, size_t length,
+                 LatticeHandle* lattice, LatticeView* output);
+
+// tokenize `n` inputs with `lengths` bytes on `numThreads` threads. If
+// numThreads is 0, all available cores are used. Items of the result are in
+// the order of inputs.
+//
+// This function will return 0 if all inputs are tokenized, or 1 if any input
+// failed. Call freeBatchResult in both cases.
+int tokenizeBatch(const Tokenizer* tokenizer, const char** inputs,
+                  const size_t* lengths, size_t n, int numThreads,
+                  BatchResult** output);
+
+// tokenizeBatch with inputs concatenated in `buffer`. The i-th input is the
+// lengths[i] bytes after the previous input. Callers can pass all inputs in one
+// buffer without an array of pointers, e.g. Go memory.
+int tokenizeBatchBuffer(const Tokenizer* tokenizer, const char* buffer,
+                        const size_t* lengths, size_t n, int numThreads,
+                        BatchResult** output);
+
+// free batch result resource
+void freeBatchResult(BatchResult* result);
+
 #ifdef __cplusplus
 }
 #endif
@@ -3,9 +3,12 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <map>
 #include <string>
 #include <vector>
 
+#include "nori/lib/dictionary/registry.h"
+
 TEST(CApiTest, tokenize) {
   Dictionary* dictionary;
   Tokenizer* tokenizer;
@@ -36,3 +39,142 @@ TEST(CApiTest, tokenize) {
   freeLattice(lattice);
   freeTokenizer(dictionary, tokenizer);
 }
+
+TEST(CApiTest, tokenizeInto) {
+  Dictionary* dictionary;
+  Tokenizer* tokenizer;
+  int status = initializeTokenizer("./dictionary/latest-dictionary.nori",
+                                   "./dictionary/latest-userdict.txt",
+                                   &dictionary, &tokenizer);
+  ASSERT_EQ(status, 0);
+
+  LatticeHandle* handle = createLatticeHandle();
+  // pos tags of morpheme ids. they don't change between calls.
+  std::map<size_t, const int*> posTags;
+  for (const std::string input :
+       {"화학 이외의 것", "세종시 대한민국날씨", "화학 이외의 것"}) {
+    Lattice* lattice;
+    ASSERT_EQ(tokenize(tokenizer, input.c_str(), &lattice), 0);
+
+    LatticeView view;
+    status = tokenizeInto(tokenizer, input.data(), input.size(), handle, &view);
+    ASSERT_EQ(status, 0);
+    ASSERT_EQ(std::string(view.sentence, view.sentenceLength),
+              lattice->sentence);
+
+    // tokens of the lattice handle don't have BOS/EOS
+    ASSERT_EQ(view.tokenLength, lattice->tokenLength - 2);
+    for (int i = 0; i < view.tokenLength; i++) {
+      const FlatToken& token = view.tokens[i];
+      const Token& expected = lattice->tokens[i + 1];
+      ASSERT_EQ(token.offset, expected.offset);
+      ASSERT_EQ(token.length, expected.length);
+      ASSERT_EQ(posTags.emplace(token.morphemeId, token.posTag).first->second,
+                token.posTag);
+      ASSERT_EQ(token.leftId, expected.morpheme.leftId);
+      ASSERT_EQ(token.rightId, expected.morpheme.rightId);
+      ASSERT_EQ(token.wordCost, expected.morpheme.wordCost);
+      ASSERT_EQ(token.posType, expected.morpheme.posType);
+      ASSERT_EQ(std::vector<int>(token.posTag,
+                                 token.posTag + token.posTagLength),
+                std::vector<int>(expected.morpheme.posTag,
+                                 expected.morpheme.posTag +
+                                     expected.morpheme.posTagLength));
+      ASSERT_EQ(token.exprLength, expected.morpheme.exprLength);
+      for (int j = 0; j < token.exprLength; j++) {
+        ASSERT_STREQ(token.expressions[j].surface,
+                     expected.morpheme.exprSurface[j]);
+        ASSERT_EQ(token.expressions[j].posTag,
+                  expected.morpheme.exprPosTag[j]);
+      }
+    }
+    freeLattice(lattice);
+  }
+
+  freeLatticeHandle(handle);
+  freeTokenizer(dictionary, tokenizer);
+}
+
+TEST(CApiTest, tokenizeBatch) {
+  Dictionary* dictionary;
+  Tokenizer* tokenizer;
+  int status = initializeTokenizer("./dictionary/latest-dictionary.nori",
+                                   "./dictionary/latest-userdict.txt",
+                                   &dictionary, &tokenizer);
+  ASSERT_EQ(status, 0);
+
+  std::vector<std::string> inputs;
+  for (int i = 0; i < 100; i++) {
+    inputs.push_back("화학 이외의 것");
+    inputs.push_back("세종시 대한민국날씨");
+    inputs.push_back("");
+  }
+  std::vector<const char*> inputPointers;
+  std::vector<size_t> lengths;
+  for (const auto& input : inputs) {
+    inputPointers.push_back(input.data());
+    lengths.push_back(input.size());
+  }
+
+  BatchResult* result;
+  status = tokenizeBatch(tokenizer, inputPointers.data(), lengths.data(),
+                         inputs.size(), 4, &result);
+  ASSERT_EQ(status, 0);
+  ASSERT_EQ(result->n, inputs.size());
+
+  LatticeHandle* handle = createLatticeHandle();
+  for (int i = 0; i < inputs.size(); i++) {
+    LatticeView expected;
+    status = tokenizeInto(tokenizer, inputs[i].data(), inputs[i].size(),
+                          handle, &expected);
+    ASSERT_EQ(status, 0);
+
+    const BatchItem& item = result->items[i];
+    ASSERT_EQ(item.status, 0);
+    ASSERT_STREQ(item.lattice.sentence, inputs[i].c_str());
+    ASSERT_EQ(item.lattice.tokenLength, expected.tokenLength);
+    for (int j = 0; j < expected.tokenLength; j++) {
+      ASSERT_EQ(item.lattice.tokens[j].offset, expected.tokens[j].offset);
+      ASSERT_EQ(item.lattice.tokens[j].length, expected.tokens[j].length);
+      ASSERT_EQ(item.lattice.tokens[j].morphemeId,
+                expected.tokens[j].morphemeId);
+      ASSERT_EQ(item.lattice.tokens[j].posTag, expected.tokens[j].posTag);
+      ASSERT_EQ(item.lattice.tokens[j].exprLength,
+                expected.tokens[j].exprLength);
+      for (int k = 0; k < expected.tokens[j].exprLength; k++)
+        ASSERT_EQ(item.lattice.tokens[j].expressions[k].surface,
+                  expected.tokens[j].expressions[k].surface);
+    }
+  }
+
+  freeLatticeHandle(handle);
+  freeBatchResult(result);
+  freeTokenizer(dictionary, tokenizer);
+}
+
+TEST(CApiTest, shareDictionary) {
+  auto& registry = nori::dictionary::DictionaryRegistry::global();
+  const size_t numDictionaries = registry.size();
+  Dictionary *dictionary, *otherDictionary;
+  Tokenizer *tokenizer, *otherTokenizer;
+  ASSERT_EQ(initializeTokenizer("./dictionary/latest-dictionary.nori", NULL,
+                                &dictionary, &tokenizer),
+            0);
+  ASSERT_EQ(initializeTokenizer("./dictionary/latest-dictionary.nori", NULL,
+                                &otherDictionary, &otherTokenizer),
+            0);
+  ASSERT_EQ(registry.size(), numDictionaries + 1);
+
+  freeTokenizer(dictionary, tokenizer);
+  ASSERT_EQ(registry.size(), numDictionaries + 1);
+  freeTokenizer(otherDictionary, otherTokenizer);
+  ASSERT_EQ(registry.size(), numDictionaries);
+
+  ASSERT_EQ(initializeTokenizer("./dictionary/missing.nori", NULL,
+                                &dictionary, &tokenizer),
+            1);
+  ASSERT_EQ(initializeTokenizer("./dictionary/latest-dictionary.nori",
+                                "./dictionary/missing.txt", &dictionary,
+                                &tokenizer),
+            2);
+}
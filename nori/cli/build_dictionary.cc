@@ -19,6 +19,28 @@ ABSL_FLAG(std::string, output, "./dictionary.nori",
 ABSL_FLAG(std::string, normalization_form, "NFKC",
           "Unicode normalization form for dictionary of MeCab");
 ABSL_FLAG(bool, normalize, true, "whether to normalize dictionary of MeCab");
+ABSL_FLAG(int, num_threads, 0,
+          "Number of threads to build dictionary. 0 means all available cores");
+ABSL_FLAG(int, memory_budget_mb, 0,
+          "Memory budget for csv rows in MiB. If it is greater than 0, the "
+          "dictionary is built with external merge sort and streamed into the "
+          "output file");
+ABSL_FLAG(std::string, temporary_directory, "/tmp",
+          "Directory for temporary files of the memory-bounded build");
+ABSL_FLAG(std::string, cache_directory, "",
+          "If set, parsed csv files, unknown tokens and connection costs are "
+          "cached in this directory, and unchanged sources are not parsed "
+          "again in the next build");
+ABSL_FLAG(bool, compact_hangul_keys, false,
+          "whether to encode Hangul syllables and Jamo of trie keys into two "
+          "bytes instead of three UTF-8 bytes");
+ABSL_FLAG(bool, aho_corasick, false,
+          "whether to build the Aho-Corasick automaton of terms. The tokenizer "
+          "matches all terms of a sentence in a single pass with it");
+ABSL_FLAG(std::string, export_connection_cost, "",
+          "If set, write the connection costs of matrix.def to this path as a "
+          "binary file. It can be swapped into a built dictionary with "
+          "replace_connection_cost");
 
 int main(int argc, char** argv) {
   absl::SetProgramUsageMessage(
@@ -36,11 +58,40 @@ int main(int argc, char** argv) {
   LOG(INFO) << "Output path: " << outputFlag;
 
   nori::dictionary::builder::DictionaryBuilder builder(
-      absl::GetFlag(FLAGS_normalize), absl::GetFlag(FLAGS_normalization_form));
-  auto status = builder.build(mecabDicFlag);
-  CHECK(status.ok()) << status.message();
-  status = builder.save(outputFlag);
-  CHECK(status.ok()) << status.message();
+      absl::GetFlag(FLAGS_normalize), absl::GetFlag(FLAGS_normalization_form),
+      absl::GetFlag(FLAGS_num_threads),
+      absl::GetFlag(FLAGS_compact_hangul_keys)
+          ? nori::protos::KeyEncoding::HANGUL_COMPACT
+          : nori::protos::KeyEncoding::UTF8,
+      absl::GetFlag(FLAGS_aho_corasick));
+  absl::Status status;
+  const int memoryBudgetMb = absl::GetFlag(FLAGS_memory_budget_mb);
+  const auto exportConnectionCostFlag =
+      absl::GetFlag(FLAGS_export_connection_cost);
+  if (memoryBudgetMb > 0) {
+    CHECK(exportConnectionCostFlag.empty())
+        << "--export_connection_cost is not supported with --memory_budget_mb";
+    LOG(INFO) << "Build with memory budget " << memoryBudgetMb << "MiB";
+    status = builder.buildStreaming(
+        mecabDicFlag, outputFlag, static_cast<size_t>(memoryBudgetMb) << 20,
+        absl::GetFlag(FLAGS_temporary_directory));
+    CHECK(status.ok()) << status.message();
+  } else {
+    const auto cacheDirectoryFlag = absl::GetFlag(FLAGS_cache_directory);
+    CHECK(cacheDirectoryFlag.empty() ||
+          nori::utils::isDirectory(cacheDirectoryFlag))
+        << "Cannot find directory " << cacheDirectoryFlag;
+    status = builder.build(mecabDicFlag, cacheDirectoryFlag);
+    CHECK(status.ok()) << status.message();
+    status = builder.save(outputFlag);
+    CHECK(status.ok()) << status.message();
+
+    if (!exportConnectionCostFlag.empty()) {
+      LOG(INFO) << "Export connection costs to " << exportConnectionCostFlag;
+      status = builder.exportConnectionCost(exportConnectionCostFlag);
+      CHECK(status.ok()) << status.message();
+    }
+  }
 
   google::protobuf::ShutdownProtobufLibrary();
   LOG(INFO) << "Done.";
@@ -0,0 +1,47 @@
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/flags/usage.h"
+#include "absl/log/check.h"
+#include "absl/log/log.h"
+#include "nori/lib/dictionary/dictionary.h"
+#include "nori/lib/protos/dictionary.pb.h"
+
+ABSL_FLAG(std::string, dictionary, "./dictionary/latest-dictionary.nori",
+          "Path to nori dictionary");
+ABSL_FLAG(std::string, user_dictionary, "./dictionary/latest-userdict.txt",
+          "Path to nori's user dictionary");
+ABSL_FLAG(std::string, output, "./userdict.nori",
+          "output filename for compiled user dictionary");
+
+int main(int argc, char** argv) {
+  absl::SetProgramUsageMessage(
+      "Compile nori's user dictionary. The compiled user dictionary can be "
+      "loaded with the same API as text user dictionaries, but it is only "
+      "valid with the dictionary that it is compiled with.");
+  absl::ParseCommandLine(argc, argv);
+
+  GOOGLE_PROTOBUF_VERIFY_VERSION;
+
+  auto dictionaryFlag = absl::GetFlag(FLAGS_dictionary);
+  auto userDictionaryFlag = absl::GetFlag(FLAGS_user_dictionary);
+  auto outputFlag = absl::GetFlag(FLAGS_output);
+
+  LOG(INFO) << "Dictionary path: " << dictionaryFlag;
+  LOG(INFO) << "User dictionary path: " << userDictionaryFlag;
+  LOG(INFO) << "Output path: " << outputFlag;
+
+  nori::dictionary::Dictionary dictionary;
+  auto status = dictionary.loadPrebuilt(dictionaryFlag);
+  CHECK(status.ok()) << status.message();
+
+  status = dictionary.loadUser(userDictionaryFlag);
+  CHECK(status.ok()) << status.message();
+  CHECK(dictionary.isUserInitialized())
+      << "There are no terms in " << userDictionaryFlag;
+
+  status = dictionary.acquireUserDict()->saveCompiled(outputFlag);
+  CHECK(status.ok()) << status.message();
+
+  google::protobuf::ShutdownProtobufLibrary();
+  LOG(INFO) << "Done.";
+}
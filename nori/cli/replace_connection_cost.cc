@@ -0,0 +1,40 @@
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/flags/usage.h"
+#include "absl/log/check.h"
+#include "absl/log/log.h"
+#include "nori/lib/dictionary/builder.h"
+#include "nori/lib/protos/dictionary.pb.h"
+
+ABSL_FLAG(std::string, dictionary, "", "Path to the nori dictionary");
+ABSL_FLAG(std::string, connection_cost, "",
+          "Path to the binary connection costs exported by build_dictionary "
+          "--export_connection_cost");
+ABSL_FLAG(std::string, output, "./dictionary.nori",
+          "output filename for nori dictionary");
+
+int main(int argc, char** argv) {
+  absl::SetProgramUsageMessage(
+      "Replace connection costs of Nori dictionary without rebuilding it.");
+  absl::ParseCommandLine(argc, argv);
+
+  GOOGLE_PROTOBUF_VERIFY_VERSION;
+
+  auto dictionaryFlag = absl::GetFlag(FLAGS_dictionary);
+  auto connectionCostFlag = absl::GetFlag(FLAGS_connection_cost);
+  auto outputFlag = absl::GetFlag(FLAGS_output);
+  LOG(INFO) << "Dictionary path: " << dictionaryFlag;
+  LOG(INFO) << "Connection cost path: " << connectionCostFlag;
+  LOG(INFO) << "Output path: " << outputFlag;
+
+  nori::dictionary::builder::DictionaryBuilder builder(false, "");
+  auto status = builder.loadPrebuilt(dictionaryFlag);
+  CHECK(status.ok()) << status.message();
+  status = builder.importConnectionCost(connectionCostFlag);
+  CHECK(status.ok()) << status.message();
+  status = builder.save(outputFlag);
+  CHECK(status.ok()) << status.message();
+
+  google::protobuf::ShutdownProtobufLibrary();
+  LOG(INFO) << "Done.";
+}
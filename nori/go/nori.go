@@ -9,12 +9,33 @@ package nori
 import "C"
 import (
 	"fmt"
+	"sync"
 	"unsafe"
 )
 
 type NoriTokenizer struct {
 	tokenizer  *C.Tokenizer
 	dictionary *C.Dictionary
+
+	// values of morphemes by morpheme ids of the C API
+	morphemesLock sync.RWMutex
+	morphemes     map[C.size_t]*morpheme
+
+	// lattice handles that are not used by TokenizeInto
+	handlesLock sync.Mutex
+	handles     []*latticeHandle
+}
+
+// Lattice handle of the C API with its output, which are reused by TokenizeInto.
+type latticeHandle struct {
+	handle  *C.LatticeHandle
+	lattice C.LatticeView
+}
+
+// Values of a morpheme that are shared by its tokens.
+type morpheme struct {
+	posTag     []int
+	expression []TokenExpression
 }
 
 type TokenExpression struct {
@@ -22,6 +43,8 @@ type TokenExpression struct {
 	POSTag  int
 }
 
+// Token of the tokenizer.
+// POSTag and Expression are shared by tokens of the same morpheme, so they must not be modified.
 type Token struct {
 	Surface string
 
@@ -35,11 +58,12 @@ type Token struct {
 
 // Create new nori tokenizer.
 // If you want to create nori tokenizer without user dictionary, just pass empty string to second parameter.
+// Tokenizers with the same dictionary paths share a dictionary in the process, and it is freed by Free of the last one.
 func New(dicPath string, userDicPath string) (*NoriTokenizer, error) {
 	cDicPath := C.CString(dicPath)
 	defer C.free(unsafe.Pointer(cDicPath))
 
-	tokenizer := NoriTokenizer{}
+	tokenizer := NoriTokenizer{morphemes: make(map[C.size_t]*morpheme)}
 	var ret int32
 	if userDicPath == "" {
 		ret = int32(C.initializeTokenizer(cDicPath, nil, &tokenizer.dictionary, &tokenizer.tokenizer))
@@ -61,62 +85,194 @@ func New(dicPath string, userDicPath string) (*NoriTokenizer, error) {
 
 // Tokenize input string.
 func (nt *NoriTokenizer) Tokenize(input string) (*[]Token, error) {
-	cInput := C.CString(input)
-	defer C.free(unsafe.Pointer(cInput))
+	tokens, err := nt.TokenizeInto(nil, input)
+	if err != nil {
+		return nil, err
+	}
 
-	var lattice *C.Lattice
-	ret := C.tokenize(nt.tokenizer, cInput, &lattice)
+	return &tokens, nil
+}
+
+// Tokenize input string, and append tokens to dst[:0].
+// Tokens are the same as the output of Tokenize. Passing the output of the previous call as dst reuses its memory, and
+// values of morphemes are cached in the tokenizer, so tokenizing doesn't allocate memory in most cases.
+func (nt *NoriTokenizer) TokenizeInto(dst []Token, input string) ([]Token, error) {
+	handle := nt.acquireHandle()
+	defer nt.releaseHandle(handle)
+
+	// Go memory without Go pointers can be passed to C during a call, so the input is passed without C.CString.
+	cInput := *(**C.char)(unsafe.Pointer(&input))
+	ret := C.tokenizeInto(nt.tokenizer, cInput, C.size_t(len(input)), handle.handle, &handle.lattice)
 	if ret == 1 {
 		return nil, fmt.Errorf("Cannot normalize input string %s", input)
 	} else if ret == 2 {
 		return nil, fmt.Errorf("Cannot tokenize input string %s", input)
 	}
-	defer C.freeLattice(lattice)
+
+	return nt.appendTokens(dst[:0], &handle.lattice, input), nil
+}
+
+// Tokenize all inputs with a single cgo call.
+// Inputs are tokenized on all available cores, and tokens of each input are the same as the output of Tokenize.
+func (nt *NoriTokenizer) TokenizeBatch(inputs []string) ([][]Token, error) {
+	// inputs are only read, so they are viewed as byte slices without copying them.
+	views := make([][]byte, len(inputs))
+	for i := range inputs {
+		views[i] = unsafe.Slice(*(**byte)(unsafe.Pointer(&inputs[i])), len(inputs[i]))
+	}
+
+	return nt.TokenizeBatchBytes(views)
+}
+
+// TokenizeBatch with byte slices.
+// Inputs are concatenated into a buffer, and passed without C.CString because Go memory without Go pointers can be
+// passed to C during a call.
+func (nt *NoriTokenizer) TokenizeBatchBytes(inputs [][]byte) ([][]Token, error) {
+	n := len(inputs)
+	if n == 0 {
+		return [][]Token{}, nil
+	}
+
+	size := 0
+	for _, input := range inputs {
+		size += len(input)
+	}
+	buffer := make([]byte, 0, size)
+	lengths := make([]C.size_t, n)
+	for i, input := range inputs {
+		buffer = append(buffer, input...)
+		lengths[i] = C.size_t(len(input))
+	}
+
+	var cBuffer *C.char
+	if size != 0 {
+		cBuffer = (*C.char)(unsafe.Pointer(&buffer[0]))
+	}
+	var result *C.BatchResult
+	C.tokenizeBatchBuffer(nt.tokenizer, cBuffer, &lengths[0], C.size_t(n), 0, &result)
+	if result == nil {
+		return nil, fmt.Errorf("Cannot allocate batch result")
+	}
+	defer C.freeBatchResult(result)
+
+	// surfaces are substrings of a single copy of the buffer.
+	sentences := string(buffer)
+	items := unsafe.Slice(result.items, n)
+	tokens := make([][]Token, n)
+	offset := 0
+	for i := range items {
+		input := sentences[offset : offset+int(lengths[i])]
+		offset += len(input)
+		if items[i].status == 1 {
+			return nil, fmt.Errorf("Cannot normalize input string %s", input)
+		} else if items[i].status == 2 {
+			return nil, fmt.Errorf("Cannot tokenize input string %s", input)
+		}
+
+		tokens[i] = nt.appendTokens(nil, &items[i].lattice, input)
+	}
+
+	return tokens, nil
+}
+
+// Append tokens of the lattice view with BOS/EOS tokens like Tokenize.
+// Surfaces are substrings of input if the normalizer didn't change it.
+func (nt *NoriTokenizer) appendTokens(dst []Token, lattice *C.LatticeView, input string) []Token {
+	dst = append(dst, Token{Surface: "BOS/EOS"})
 
 	tokenLength := int(lattice.tokenLength)
-	tokens := make([]Token, tokenLength)
-	sentence := C.GoString(lattice.sentence)
-	cTokens := (*[1 << 30]C.Token)(unsafe.Pointer(lattice.tokens))
-
-	tokens[0].Surface = "BOS/EOS"
-	tokens[tokenLength-1].Surface = "BOS/EOS"
-
-	for i := 1; i < tokenLength-1; i++ {
-		cToken := cTokens[i]
-		start := int(cToken.offset)
-		end := start + int(cToken.length)
-
-		tokens[i].Surface = sentence[start:end]
-
-		cMorpheme := cToken.morpheme
-		tokens[i].LeftId = int(cMorpheme.leftId)
-		tokens[i].RightId = int(cMorpheme.rightId)
-		tokens[i].WordCost = int(cMorpheme.wordCost)
-		tokens[i].POSType = int(cMorpheme.posType)
-
-		posTagLength := int(cMorpheme.posTagLength)
-		tokens[i].POSTag = make([]int, int(cMorpheme.posTagLength))
-		cPOSTag := (*[1 << 30]C.int)(unsafe.Pointer(cMorpheme.posTag))
-		for j := 0; j < posTagLength; j++ {
-			tokens[i].POSTag[j] = int(cPOSTag[j])
+	if tokenLength != 0 {
+		sentence := input
+		sentenceLength := int(lattice.sentenceLength)
+		if sentenceLength != len(input) ||
+			string(unsafe.Slice((*byte)(unsafe.Pointer(lattice.sentence)), sentenceLength)) != input {
+			sentence = C.GoStringN(lattice.sentence, C.int(sentenceLength))
 		}
 
-		expressionLength := int(cMorpheme.exprLength)
-		tokens[i].Expression = make([]TokenExpression, expressionLength)
-		if expressionLength != 0 {
-			cExprPOS := (*[1 << 30]C.int)(unsafe.Pointer(cMorpheme.exprPosTag))
-			cExprSurface := (*[1 << 30]*C.char)(unsafe.Pointer(cMorpheme.exprSurface))
+		cTokens := unsafe.Slice(lattice.tokens, tokenLength)
+		for i := range cTokens {
+			cToken := &cTokens[i]
+			start := int(cToken.offset)
+			end := start + int(cToken.length)
+			morpheme := nt.getMorpheme(cToken)
 
-			for j := 0; j < expressionLength; j++ {
-				tokens[i].Expression[j].POSTag = int(cExprPOS[j])
-				tokens[i].Expression[j].Surface = C.GoString(cExprSurface[j])
-			}
+			dst = append(dst, Token{
+				Surface:    sentence[start:end],
+				LeftId:     int(cToken.leftId),
+				RightId:    int(cToken.rightId),
+				WordCost:   int(cToken.wordCost),
+				POSType:    int(cToken.posType),
+				POSTag:     morpheme.posTag,
+				Expression: morpheme.expression,
+			})
 		}
 	}
 
-	return &tokens, nil
+	return append(dst, Token{Surface: "BOS/EOS"})
+}
+
+// Return values of the morpheme of the token. They are copied from C only for the first token of the morpheme.
+func (nt *NoriTokenizer) getMorpheme(cToken *C.FlatToken) *morpheme {
+	nt.morphemesLock.RLock()
+	value, ok := nt.morphemes[cToken.morphemeId]
+	nt.morphemesLock.RUnlock()
+	if ok {
+		return value
+	}
+
+	value = &morpheme{}
+	posTagLength := int(cToken.posTagLength)
+	value.posTag = make([]int, posTagLength)
+	if posTagLength != 0 {
+		cPOSTag := unsafe.Slice(cToken.posTag, posTagLength)
+		for j := range cPOSTag {
+			value.posTag[j] = int(cPOSTag[j])
+		}
+	}
+
+	expressionLength := int(cToken.exprLength)
+	value.expression = make([]TokenExpression, expressionLength)
+	if expressionLength != 0 {
+		cExpressions := unsafe.Slice(cToken.expressions, expressionLength)
+		for j := range cExpressions {
+			value.expression[j].POSTag = int(cExpressions[j].posTag)
+			value.expression[j].Surface = C.GoString(cExpressions[j].surface)
+		}
+	}
+
+	nt.morphemesLock.Lock()
+	defer nt.morphemesLock.Unlock()
+	if cached, ok := nt.morphemes[cToken.morphemeId]; ok {
+		return cached
+	}
+	nt.morphemes[cToken.morphemeId] = value
+	return value
+}
+
+// Return a lattice handle that is not used by other goroutines.
+func (nt *NoriTokenizer) acquireHandle() *latticeHandle {
+	nt.handlesLock.Lock()
+	defer nt.handlesLock.Unlock()
+
+	if len(nt.handles) == 0 {
+		return &latticeHandle{handle: C.createLatticeHandle()}
+	}
+	handle := nt.handles[len(nt.handles)-1]
+	nt.handles = nt.handles[:len(nt.handles)-1]
+	return handle
+}
+
+func (nt *NoriTokenizer) releaseHandle(handle *latticeHandle) {
+	nt.handlesLock.Lock()
+	defer nt.handlesLock.Unlock()
+
+	nt.handles = append(nt.handles, handle)
 }
 
 func (nt *NoriTokenizer) Free() {
+	for _, handle := range nt.handles {
+		C.freeLatticeHandle(handle.handle)
+	}
+	nt.handles = nil
 	C.freeTokenizer(nt.dictionary, nt.tokenizer)
 }
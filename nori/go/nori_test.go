@@ -1,6 +1,10 @@
 package nori
 
-import "testing"
+import (
+	"reflect"
+	"strings"
+	"testing"
+)
 
 func TestLoadNoriTokenizer(t *testing.T) {
 	tokenizer, err := New("../../dictionary/latest-dictionary.nori", "../../dictionary/latest-userdict.txt")
@@ -75,3 +79,96 @@ func TestRegression(t *testing.T) {
 		t.FailNow()
 	}
 }
+
+func TestTokenizeBatch(t *testing.T) {
+	tokenizer, err := New("../../dictionary/latest-dictionary.nori", "")
+	if err != nil {
+		t.Log(err)
+		t.FailNow()
+	}
+	defer tokenizer.Free()
+
+	inputs := []string{
+		"화학 이외의 것",
+		"",
+		"Nori-clone은 c++로 Nori를 재작성하기 위한 프로젝트입니다.",
+		"㈜《―旅客運輸 株式會社》",
+	}
+	byteInputs := make([][]byte, len(inputs))
+	for i, input := range inputs {
+		byteInputs[i] = []byte(input)
+	}
+
+	batchTokens, err := tokenizer.TokenizeBatch(inputs)
+	if err != nil {
+		t.Log(err)
+		t.FailNow()
+	}
+	byteBatchTokens, err := tokenizer.TokenizeBatchBytes(byteInputs)
+	if err != nil {
+		t.Log(err)
+		t.FailNow()
+	}
+	if len(batchTokens) != len(inputs) || len(byteBatchTokens) != len(inputs) {
+		t.FailNow()
+	}
+	// surfaces don't refer to byte slices of the caller.
+	for _, input := range byteInputs {
+		for j := range input {
+			input[j] = 'x'
+		}
+	}
+
+	for i, input := range inputs {
+		tokens, err := tokenizer.Tokenize(input)
+		if err != nil {
+			t.Log(err)
+			t.FailNow()
+		}
+		if !reflect.DeepEqual(*tokens, batchTokens[i]) {
+			t.Errorf("[%d] tokens are not equal, \n expected: %v, actual: %v", i, *tokens, batchTokens[i])
+		}
+		if !reflect.DeepEqual(*tokens, byteBatchTokens[i]) {
+			t.Errorf("[%d] tokens are not equal, \n expected: %v, actual: %v", i, *tokens, byteBatchTokens[i])
+		}
+	}
+}
+
+func TestTokenizeInto(t *testing.T) {
+	tokenizer, err := New("../../dictionary/latest-dictionary.nori", "")
+	if err != nil {
+		t.Log(err)
+		t.FailNow()
+	}
+	defer tokenizer.Free()
+
+	var dst []Token
+	for _, input := range []string{"화학 이외의 것", "", "세종시 대한민국날씨", "화학 이외의 것"} {
+		expected, err := tokenizer.Tokenize(input)
+		if err != nil {
+			t.Log(err)
+			t.FailNow()
+		}
+
+		dst, err = tokenizer.TokenizeInto(dst, input)
+		if err != nil {
+			t.Log(err)
+			t.FailNow()
+		}
+		if !reflect.DeepEqual(*expected, dst) {
+			t.Errorf("tokens are not equal, \n expected: %v, actual: %v", *expected, dst)
+		}
+	}
+
+	// tokenizing into the previous output doesn't allocate memory per token
+	allocs := func(input string) float64 {
+		dst, _ = tokenizer.TokenizeInto(dst, input)
+		return testing.AllocsPerRun(100, func() {
+			dst, _ = tokenizer.TokenizeInto(dst, input)
+		})
+	}
+	input := "세종시 대한민국날씨"
+	if allocs(input) != allocs(strings.Repeat(input+" ", 10)) {
+		t.Errorf("TokenizeInto allocates memory per token")
+	}
+}
@@ -0,0 +1,275 @@
+#include "nori/lib/dictionary/aho_corasick.h"
+
+#include <algorithm>
+#include <numeric>
+#include <queue>
+#include <string>
+
+#include "absl/strings/str_cat.h"
+
+namespace nori {
+namespace dictionary {
+
+namespace internal {
+
+// Slots of the double array that are not used by any state. find returns the
+// smallest free slot that is not less than `index` with path compression.
+class FreeSlots {
+ public:
+  int find(int index) {
+    int slot = index;
+    while (slot < nextFree.size() && nextFree[slot] != slot)
+      slot = nextFree[slot];
+    while (index < nextFree.size() && nextFree[index] != index) {
+      const int next = nextFree[index];
+      nextFree[index] = slot;
+      index = next;
+    }
+    return slot;
+  }
+
+  void use(int index) {
+    grow(index + 1);
+    nextFree[index] = index + 1;
+  }
+
+  void grow(int size) {
+    for (int i = nextFree.size(); i < size; i++) nextFree.push_back(i);
+  }
+
+ private:
+  std::vector<int> nextFree;
+};
+
+absl::Status buildAhoCorasick(const std::vector<absl::string_view>& keys,
+                              nori::protos::AhoCorasick* output) {
+  if (keys.empty())
+    return absl::InvalidArgumentError("No keys to build Aho-Corasick");
+
+  std::vector<int> order(keys.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(),
+                   [&](int a, int b) { return keys[a] < keys[b]; });
+  for (int i = 0; i < order.size(); i++) {
+    const auto key = keys[order[i]];
+    if (key.empty() || key.find('\0') != absl::string_view::npos)
+      return absl::InvalidArgumentError(
+          absl::StrCat("Cannot add key to Aho-Corasick: ", key));
+    if (i > 0 && keys[order[i - 1]] == key)
+      return absl::InvalidArgumentError(absl::StrCat("Duplicated key: ", key));
+  }
+
+  std::vector<int32_t> bases, fails, values, outputs;
+  std::string labels;
+  std::vector<bool> usedBases;
+  FreeSlots freeSlots;
+  // free slots that are tried as the slot of the first child. A slot is
+  // dropped after it fails kMaxTrials times, so searches don't scan the same
+  // holes of dense regions again.
+  constexpr int kMaxTrials = 16;
+  FreeSlots candidateSlots;
+  std::vector<uint8_t> numTrials;
+  const auto grow = [&](int size) {
+    if (size <= bases.size()) return;
+    bases.resize(size, -1);
+    fails.resize(size, 0);
+    values.resize(size, -1);
+    outputs.resize(size, -1);
+    labels.resize(size, '\0');
+    usedBases.resize(size, false);
+    numTrials.resize(size, 0);
+    freeSlots.grow(size);
+    candidateSlots.grow(size);
+  };
+  // transition with fail links of the states that are already placed
+  const auto next = [&](int state, unsigned char c) {
+    while (true) {
+      const int base = bases[state];
+      if (base >= 0 && static_cast<unsigned char>(labels[base + c]) == c)
+        return base + c;
+      if (state == 0) return 0;
+      state = fails[state];
+    }
+  };
+
+  // States are placed in breadth-first order, so fail links of children can
+  // be computed with the states of lower depths. Each state covers the range
+  // of sorted keys that start with its prefix.
+  struct State {
+    int index;
+    int begin, end;
+    size_t depth;
+  };
+  std::queue<State> queue;
+  grow(256);
+  freeSlots.use(0);
+  candidateSlots.use(0);
+  queue.push({0, 0, static_cast<int>(order.size()), 0});
+
+  std::vector<std::pair<unsigned char, int>> children;
+  while (!queue.empty()) {
+    const State state = queue.front();
+    queue.pop();
+
+    // the first key ends at this state if its length is the depth.
+    children.clear();
+    for (int i = state.begin; i < state.end; i++) {
+      const auto key = keys[order[i]];
+      if (key.size() == state.depth) continue;
+      const unsigned char label = key[state.depth];
+      if (children.empty() || children.back().first != label)
+        children.emplace_back(label, i);
+    }
+    if (children.empty()) continue;
+
+    // find an unused base where all children fit.
+    const unsigned char firstLabel = children[0].first;
+    int base;
+    for (int slot = candidateSlots.find(firstLabel);;
+         slot = candidateSlots.find(slot + 1)) {
+      base = slot - firstLabel;
+      grow(base + 256);
+      if (!usedBases[base] &&
+          std::all_of(children.begin() + 1, children.end(),
+                      [&](const std::pair<unsigned char, int>& child) {
+                        return freeSlots.find(base + child.first) ==
+                               base + child.first;
+                      }))
+        break;
+      if (++numTrials[slot] >= kMaxTrials) candidateSlots.use(slot);
+    }
+    usedBases[base] = true;
+    bases[state.index] = base;
+
+    for (int i = 0; i < children.size(); i++) {
+      const unsigned char label = children[i].first;
+      const int child = base + label;
+      const int begin = children[i].second;
+      const int end =
+          i + 1 < children.size() ? children[i + 1].second : state.end;
+
+      freeSlots.use(child);
+      candidateSlots.use(child);
+      labels[child] = static_cast<char>(label);
+      if (keys[order[begin]].size() == state.depth + 1)
+        values[child] = order[begin];
+      fails[child] = state.index == 0 ? 0 : next(fails[state.index], label);
+      outputs[child] =
+          values[fails[child]] >= 0 ? fails[child] : outputs[fails[child]];
+      queue.push({child, begin, end, state.depth + 1});
+    }
+  }
+
+  output->Clear();
+  output->mutable_bases()->Add(bases.begin(), bases.end());
+  output->set_labels(labels);
+  output->mutable_fails()->Add(fails.begin(), fails.end());
+  output->mutable_values()->Add(values.begin(), values.end());
+  output->mutable_outputs()->Add(outputs.begin(), outputs.end());
+  output->mutable_key_lengths()->Reserve(keys.size());
+  for (const auto& key : keys) output->add_key_lengths(key.size());
+  return absl::OkStatus();
+}
+
+}  // namespace internal
+
+namespace {
+
+// compute depths of the states of `message` from the labels and the bases of
+// their parents. Unused slots have the label 0 and the depth -1. It returns
+// false if a state has no parent, two states share a base or parents form a
+// cycle.
+bool computeDepths(const nori::protos::AhoCorasick& message,
+                   std::vector<int>& depths) {
+  const int size = message.bases_size();
+  const auto& labels = message.labels();
+
+  // the state of each base
+  std::vector<int> owners(size, -1);
+  for (int i = 0; i < size; i++) {
+    const int base = message.bases(i);
+    if (base < 0) continue;
+    if (owners[base] >= 0) return false;
+    owners[base] = i;
+  }
+
+  // -2 marks states of the current walk to the root
+  depths.assign(size, -1);
+  depths[0] = 0;
+  std::vector<int> walk;
+  for (int i = 1; i < size; i++) {
+    if (labels[i] == '\0' || depths[i] >= 0) continue;
+
+    int state = i;
+    while (depths[state] < 0) {
+      if (depths[state] == -2) return false;
+      const unsigned char label = labels[state];
+      const int base = state - label;
+      if (label == 0 || base < 0 || owners[base] < 0) return false;
+      depths[state] = -2;
+      walk.push_back(state);
+      state = owners[base];
+    }
+    for (int depth = depths[state] + 1; !walk.empty(); depth++) {
+      depths[walk.back()] = depth;
+      walk.pop_back();
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+absl::Status AhoCorasick::load(const nori::protos::AhoCorasick& message) {
+  numStates = 0;
+  const int size = message.bases_size();
+  const int numKeys = message.key_lengths_size();
+  if (message.labels().size() != size || message.fails_size() != size ||
+      message.values_size() != size || message.outputs_size() != size)
+    return absl::InvalidArgumentError("Malformed Aho-Corasick automaton");
+
+  for (int i = 0; i < size; i++) {
+    const int base = message.bases(i);
+    if ((base >= 0 && base > size - 256) || message.fails(i) < 0 ||
+        message.fails(i) >= size || message.values(i) < -1 ||
+        message.values(i) >= numKeys || message.outputs(i) < -1 ||
+        message.outputs(i) >= size)
+      return absl::InvalidArgumentError("Malformed Aho-Corasick automaton");
+  }
+  for (int i = 0; i < numKeys; i++) {
+    if (message.key_lengths(i) <= 0)
+      return absl::InvalidArgumentError("Malformed Aho-Corasick automaton");
+  }
+
+  // match reports the length of the key of a state as the offset, and follows
+  // fail links and outputs until the root. A key must end at its depth, and
+  // links must go to shallower states, so offsets are right and match always
+  // returns.
+  std::vector<int> depths;
+  if (size == 0 || !computeDepths(message, depths))
+    return absl::InvalidArgumentError("Malformed Aho-Corasick automaton");
+  for (int i = 0; i < size; i++) {
+    if (depths[i] < 0) continue;
+    const int value = message.values(i);
+    const int fail = message.fails(i);
+    const int output = message.outputs(i);
+    if ((value >= 0 && message.key_lengths(value) != depths[i]) ||
+        (i != 0 && !(depths[fail] >= 0 && depths[fail] < depths[i])) ||
+        (output >= 0 &&
+         !(depths[output] >= 0 && depths[output] < depths[i] &&
+           message.values(output) >= 0)))
+      return absl::InvalidArgumentError("Malformed Aho-Corasick automaton");
+  }
+
+  bases = message.bases().data();
+  labels = reinterpret_cast<const unsigned char*>(message.labels().data());
+  fails = message.fails().data();
+  values = message.values().data();
+  outputs = message.outputs().data();
+  keyLengths = message.key_lengths().data();
+  numStates = size;
+  return absl::OkStatus();
+}
+
+}  // namespace dictionary
+}  // namespace nori
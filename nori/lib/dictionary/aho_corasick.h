@@ -0,0 +1,84 @@
+#ifndef __NORI_DICTIONARY_AHO_CORASICK_H__
+#define __NORI_DICTIONARY_AHO_CORASICK_H__
+
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "nori/lib/protos/dictionary.pb.h"
+
+namespace nori {
+namespace dictionary {
+
+namespace internal {
+
+// build the Aho-Corasick automaton of `keys` into `output`. The value of each
+// key is its index, and keys must be unique.
+absl::Status buildAhoCorasick(const std::vector<absl::string_view>& keys,
+                              nori::protos::AhoCorasick* output);
+
+}  // namespace internal
+
+// Aho-Corasick automaton over bytes in a double array.
+//
+// The transition of the state s with the byte c goes to base[s] + c if
+// label[base[s] + c] == c. Bases are unique among states, so the label is
+// enough to check the parent of a state. States without children have a
+// negative base, and the root is the state 0.
+//
+// Unlike the trie that is searched from every position, the automaton finds
+// all keys in a text with a single pass.
+class AhoCorasick {
+ public:
+  // use arrays of `message` without copying them. `message` should outlive
+  // this object.
+  absl::Status load(const nori::protos::AhoCorasick& message);
+
+  bool isLoaded() const { return numStates > 0; }
+
+  // call `onMatch(offset, length, value)` for all keys in `text`. Matches are
+  // reported in order of their end offsets, and longer matches first for the
+  // same end offset.
+  template <class Function>
+  void match(absl::string_view text, Function onMatch) const {
+    int state = 0;
+    for (size_t i = 0; i < text.size(); i++) {
+      state = next(state, static_cast<unsigned char>(text[i]));
+
+      for (int s = values[state] >= 0 ? state : outputs[state]; s >= 0;
+           s = outputs[s]) {
+        const int length = keyLengths[values[s]];
+        onMatch(i + 1 - length, length, values[s]);
+      }
+    }
+  }
+
+ private:
+  int next(int state, unsigned char c) const {
+    // the label 0 marks unused slots.
+    if (c == 0) return 0;
+
+    while (true) {
+      const int base = bases[state];
+      if (base >= 0 && labels[base + c] == c) return base + c;
+      if (state == 0) return 0;
+      state = fails[state];
+    }
+  }
+
+  int numStates = 0;
+  const google::protobuf::int32* bases;
+  const unsigned char* labels;
+  const google::protobuf::int32* fails;
+  // value of the key that ends at the state, or -1
+  const google::protobuf::int32* values;
+  // the longest proper suffix state with a value, or -1
+  const google::protobuf::int32* outputs;
+  // length of keys by values
+  const google::protobuf::int32* keyLengths;
+};
+
+}  // namespace dictionary
+}  // namespace nori
+
+#endif  // __NORI_DICTIONARY_AHO_CORASICK_H__
@@ -0,0 +1,141 @@
+#include "nori/lib/dictionary/aho_corasick.h"
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <set>
+#include <tuple>
+
+using namespace nori::dictionary;
+
+namespace {
+
+std::set<std::tuple<size_t, int, int>> match(const AhoCorasick& ahoCorasick,
+                                             absl::string_view text) {
+  std::set<std::tuple<size_t, int, int>> matches;
+  size_t lastEnd = 0;
+  ahoCorasick.match(text, [&](size_t offset, int length, int value) {
+    // matches are reported in order of their end offsets
+    EXPECT_GE(offset + length, lastEnd);
+    lastEnd = offset + length;
+    matches.emplace(offset, length, value);
+  });
+  return matches;
+}
+
+}  // namespace
+
+TEST(TestAhoCorasick, match) {
+  const std::vector<absl::string_view> keys = {"he", "she", "his", "hers",
+                                               "세종", "종시", "세종시"};
+  nori::protos::AhoCorasick message;
+  auto status = internal::buildAhoCorasick(keys, &message);
+  ASSERT_TRUE(status.ok()) << status.message();
+
+  AhoCorasick ahoCorasick;
+  status = ahoCorasick.load(message);
+  ASSERT_TRUE(status.ok()) << status.message();
+
+  const std::set<std::tuple<size_t, int, int>> expected = {
+      {1, 3, 1}, {2, 2, 0}, {2, 4, 3}};
+  ASSERT_EQ(match(ahoCorasick, "ushers"), expected);
+
+  const std::string sejong = "세종시";
+  const std::set<std::tuple<size_t, int, int>> expectedSejong = {
+      {0, 6, 4}, {0, 9, 6}, {3, 6, 5}};
+  ASSERT_EQ(match(ahoCorasick, sejong), expectedSejong);
+  ASSERT_TRUE(match(ahoCorasick, std::string("h\0is", 4)).empty());
+}
+
+TEST(TestAhoCorasick, matchRandom) {
+  // a small alphabet to have many overlapping matches
+  const char alphabet[] = {'a', 'b', '\xea', '\xb0'};
+  std::mt19937 random(1234);
+  std::uniform_int_distribution<int> letter(0, 3), length(1, 6);
+  const auto randomString = [&](int size) {
+    std::string output;
+    for (int i = 0; i < size; i++) output.push_back(alphabet[letter(random)]);
+    return output;
+  };
+
+  std::set<std::string> uniqueKeys;
+  while (uniqueKeys.size() < 200)
+    uniqueKeys.insert(randomString(length(random)));
+  const std::vector<std::string> keyStrings(uniqueKeys.begin(),
+                                            uniqueKeys.end());
+  const std::vector<absl::string_view> keys(keyStrings.begin(),
+                                            keyStrings.end());
+
+  nori::protos::AhoCorasick message;
+  auto status = internal::buildAhoCorasick(keys, &message);
+  ASSERT_TRUE(status.ok()) << status.message();
+  AhoCorasick ahoCorasick;
+  status = ahoCorasick.load(message);
+  ASSERT_TRUE(status.ok()) << status.message();
+
+  for (int i = 0; i < 100; i++) {
+    const std::string text = randomString(64);
+    std::set<std::tuple<size_t, int, int>> expected;
+    for (int k = 0; k < keys.size(); k++) {
+      for (size_t offset = text.find(keyStrings[k]);
+           offset != std::string::npos;
+           offset = text.find(keyStrings[k], offset + 1))
+        expected.emplace(offset, keys[k].size(), k);
+    }
+    ASSERT_EQ(match(ahoCorasick, text), expected) << text;
+  }
+}
+
+TEST(TestAhoCorasick, invalidKeys) {
+  nori::protos::AhoCorasick message;
+  ASSERT_FALSE(internal::buildAhoCorasick({}, &message).ok());
+  ASSERT_FALSE(internal::buildAhoCorasick({"a", "b", "a"}, &message).ok());
+  ASSERT_FALSE(internal::buildAhoCorasick({"a", ""}, &message).ok());
+
+  ASSERT_TRUE(internal::buildAhoCorasick({"a", "b"}, &message).ok());
+  message.mutable_values()->RemoveLast();
+  AhoCorasick ahoCorasick;
+  ASSERT_FALSE(ahoCorasick.load(message).ok());
+  ASSERT_FALSE(ahoCorasick.isLoaded());
+}
+
+TEST(TestAhoCorasick, malformedAutomaton) {
+  nori::protos::AhoCorasick message;
+  ASSERT_TRUE(internal::buildAhoCorasick({"he", "she"}, &message).ok());
+  AhoCorasick ahoCorasick;
+  ASSERT_TRUE(ahoCorasick.load(message).ok());
+
+  // states of "he" and "she"
+  int he = -1, she = -1;
+  for (int i = 0; i < message.values_size(); i++) {
+    if (message.values(i) == 0) he = i;
+    if (message.values(i) == 1) she = i;
+  }
+  ASSERT_GE(he, 0);
+  ASSERT_GE(she, 0);
+  ASSERT_EQ(message.outputs(she), he);
+
+  // a key length that doesn't match the depth of its state
+  nori::protos::AhoCorasick malformed = message;
+  malformed.set_key_lengths(1, 2);
+  ASSERT_FALSE(ahoCorasick.load(malformed).ok());
+  malformed.set_key_lengths(1, -3);
+  ASSERT_FALSE(ahoCorasick.load(malformed).ok());
+
+  // outputs and fail links that loop
+  malformed = message;
+  malformed.set_outputs(she, she);
+  ASSERT_FALSE(ahoCorasick.load(malformed).ok());
+  malformed = message;
+  malformed.set_outputs(he, she);
+  ASSERT_FALSE(ahoCorasick.load(malformed).ok());
+  malformed = message;
+  malformed.set_fails(she, she);
+  ASSERT_FALSE(ahoCorasick.load(malformed).ok());
+
+  // an output state without a key
+  malformed = message;
+  malformed.set_outputs(she, 0);
+  ASSERT_FALSE(ahoCorasick.load(malformed).ok());
+  ASSERT_FALSE(ahoCorasick.isLoaded());
+}
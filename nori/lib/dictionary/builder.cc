@@ -1,13 +1,28 @@
 #include "nori/lib/dictionary/builder.h"
 
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+#include <unistd.h>
+
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
-#include <regex>
+#include <future>
+#include <iterator>
+#include <limits>
+#include <queue>
 #include <sstream>
+#include <thread>
 
 #include "absl/log/log.h"
+#include "absl/strings/ascii.h"
 #include "absl/strings/match.h"
 #include "absl/strings/str_split.h"
+#include "absl/strings/strip.h"
+#include "nori/lib/dictionary/dictionary.h"
 #include "nori/lib/protos/dictionary.pb.h"
 #include "nori/lib/utils.h"
 #include "snappy.h"
@@ -18,7 +33,7 @@ namespace builder {
 
 namespace internal {
 
-absl::Status convertMeCabCSVEntry(const std::vector<std::string>& entry,
+absl::Status convertMeCabCSVEntry(const std::vector<absl::string_view>& entry,
                                   nori::protos::Morpheme* morpheme) {
   morpheme->set_left_id(utils::internal::simpleAtoi(entry.at(1)));
   morpheme->set_right_id(utils::internal::simpleAtoi(entry.at(2)));
@@ -28,17 +43,14 @@ absl::Status convertMeCabCSVEntry(const std::vector<std::string>& entry,
   morpheme->set_pos_type(posType);
 
   auto posTagList = morpheme->mutable_pos_tags();
-  std::string posTags = entry.at(4);
-  std::vector<std::string> posTokens = absl::StrSplit(posTags, '+');
-  for (const auto& posToken : posTokens) {
+  for (absl::string_view posToken : absl::StrSplit(entry.at(4), '+')) {
     posTagList->Add(utils::resolvePOSTag(posToken));
   }
 
-  if (entry.at(11) != "*") {
-    std::string expression = entry.at(11);
-    std::vector<std::string> expressionTokens = absl::StrSplit(expression, '+');
-    for (const auto& expressionToken : expressionTokens) {
-      std::vector<std::string> tokenSplit =
+  const absl::string_view expression = entry.at(11);
+  if (expression != "*") {
+    for (absl::string_view expressionToken : absl::StrSplit(expression, '+')) {
+      std::vector<absl::string_view> tokenSplit =
           absl::StrSplit(expressionToken, '/');
       if (tokenSplit.size() != 3) {
         return absl::InvalidArgumentError(
@@ -47,13 +59,85 @@ absl::Status convertMeCabCSVEntry(const std::vector<std::string>& entry,
 
       const auto token = morpheme->add_expression();
       token->set_pos_tag(utils::resolvePOSTag(tokenSplit.at(1)));
-      token->set_surface(tokenSplit.at(0));
+      token->set_surface(tokenSplit.at(0).data(), tokenSplit.at(0).size());
+    }
+  }
+
+  return absl::OkStatus();
+}
+
+absl::Status convertMeCabCSVEntry(const std::vector<std::string>& entry,
+                                  nori::protos::Morpheme* morpheme) {
+  const std::vector<absl::string_view> views(entry.begin(), entry.end());
+  return convertMeCabCSVEntry(views, morpheme);
+}
+
+absl::Status readMeCabCSVFile(const std::string& path, bool normalize,
+                              const std::string& normalizationForm,
+                              CSVFile& output) {
+  std::ifstream ifs(path, std::ios::in | std::ios::binary);
+  if (ifs.fail())
+    return absl::InvalidArgumentError(absl::StrCat(path, " is missing"));
+
+  std::stringstream buf;
+  buf << ifs.rdbuf();
+  ifs.close();
+
+  // Unicode normalization never composes characters across a line feed, so
+  // normalizing the whole file at once equals to normalizing line by line.
+  if (normalize) {
+    auto status = utils::internal::normalizeUTF8(buf.str(), output.content,
+                                                 normalizationForm);
+    if (!status.ok())
+      return absl::InternalError(
+          absl::StrCat("Cannot normalize string in ", path));
+  } else {
+    output.content = buf.str();
+  }
+
+  absl::string_view content = output.content;
+  absl::ConsumeSuffix(&content, "\n");
+  if (content.empty()) return absl::OkStatus();
+
+  for (absl::string_view line : absl::StrSplit(content, '\n')) {
+    std::vector<absl::string_view> entry;
+    entry.reserve(12);
+    utils::internal::parseCSVLine(line, entry);
+
+    if (entry.size() < 12) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "Entry in CSV is not valid (12 field values expected): ", line));
     }
+    entry[0] = absl::StripAsciiWhitespace(entry[0]);
+
+    output.rows.push_back(std::move(entry));
   }
 
   return absl::OkStatus();
 }
 
+int resolveNumThreads(int numThreads) {
+  if (numThreads > 0) return numThreads;
+  return std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+}
+
+int64_t elapsedMs(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+// serialize the first code point bitmap of trie keys into `output`.
+void buildFirstCodePoints(const std::vector<absl::string_view>& keys,
+                          std::string* output) {
+  dictionary::internal::FirstCodePointBitmap bitmap;
+  for (const auto& key : keys) bitmap.add(key);
+
+  const auto& words = bitmap.getWords();
+  output->assign(reinterpret_cast<const char*>(words.data()),
+                 words.size() * sizeof(uint64_t));
+}
+
 // serialize, compress, and save protobuf message
 template <class T>
 absl::Status serializeCompressedProtobuf(const std::string path,
@@ -74,11 +158,486 @@ absl::Status serializeCompressedProtobuf(const std::string path,
   return absl::OkStatus();
 }
 
+// Parse an integer after spaces. `current` points to the next character of
+// the integer after this function.
+inline bool consumeInt(const char*& current, const char* end, int& output) {
+  while (current < end && (*current == ' ' || *current == '\t')) current++;
+
+  bool negative = false;
+  if (current < end && (*current == '-' || *current == '+')) {
+    negative = *current == '-';
+    current++;
+  }
+
+  const char* digitsBegin = current;
+  int64_t value = 0;
+  while (current < end && '0' <= *current && *current <= '9') {
+    value = value * 10 + (*current - '0');
+    if (value > std::numeric_limits<int>::max()) return false;
+    current++;
+  }
+  if (current == digitsBegin) return false;
+
+  output = static_cast<int>(negative ? -value : value);
+  return true;
+}
+
+absl::Status parseMatrixDefLines(const char* begin, const char* end,
+                                 int forwardSize, int backwardSize,
+                                 int* costs) {
+  const char* current = begin;
+  while (current < end) {
+    const char* lineEnd =
+        static_cast<const char*>(std::memchr(current, '\n', end - current));
+    if (lineEnd == nullptr) lineEnd = end;
+
+    const char* lineBegin = current;
+    int forwardId, backwardId, cost;
+    if (!consumeInt(current, lineEnd, forwardId) ||
+        !consumeInt(current, lineEnd, backwardId) ||
+        !consumeInt(current, lineEnd, cost)) {
+      // skip empty lines
+      if (absl::StripAsciiWhitespace(absl::string_view(
+                                         lineBegin, lineEnd - lineBegin))
+              .empty()) {
+        current = lineEnd + 1;
+        continue;
+      }
+      return absl::InvalidArgumentError(absl::StrCat(
+          "Malformed matrix.def: ",
+          absl::string_view(lineBegin, lineEnd - lineBegin)));
+    }
+
+    while (current < lineEnd && absl::ascii_isspace(*current)) current++;
+    if (current != lineEnd || forwardId < 0 || forwardId >= forwardSize ||
+        backwardId < 0 || backwardId >= backwardSize) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "Malformed matrix.def: ",
+          absl::string_view(lineBegin, lineEnd - lineBegin)));
+    }
+
+    costs[static_cast<size_t>(backwardSize) * forwardId + backwardId] = cost;
+    current = lineEnd + 1;
+  }
+
+  return absl::OkStatus();
+}
+
+constexpr char kConnectionCostMagic[] = "NORICOST";
+constexpr size_t kConnectionCostMagicSize = sizeof(kConnectionCostMagic) - 1;
+
+absl::Status saveBinaryConnectionCost(
+    const std::string& path,
+    const nori::protos::ConnectionCost& connectionCost) {
+  std::ofstream ofs(path, std::ios::out | std::ios::binary);
+  if (ofs.fail())
+    return absl::InvalidArgumentError(absl::StrCat("Cannot open file ", path));
+
+  const int32_t sizes[2] = {connectionCost.forward_size(),
+                            connectionCost.backward_size()};
+  ofs.write(kConnectionCostMagic, kConnectionCostMagicSize);
+  ofs.write(reinterpret_cast<const char*>(sizes), sizeof(sizes));
+  ofs.write(reinterpret_cast<const char*>(connectionCost.cost_lists().data()),
+            sizeof(int32_t) * connectionCost.cost_lists_size());
+  ofs.close();
+
+  if (ofs.fail())
+    return absl::InternalError(absl::StrCat("Cannot write file ", path));
+  return absl::OkStatus();
+}
+
+absl::Status loadBinaryConnectionCost(
+    const std::string& path, nori::protos::ConnectionCost* connectionCost) {
+  utils::internal::MappedFile file;
+  auto status = file.open(path);
+  if (!status.ok()) return status;
+
+  const size_t headerSize = kConnectionCostMagicSize + sizeof(int32_t) * 2;
+  if (file.getSize() < headerSize ||
+      std::memcmp(file.getData(), kConnectionCostMagic,
+                  kConnectionCostMagicSize) != 0)
+    return absl::InvalidArgumentError(
+        absl::StrCat("Not a binary connection cost file ", path));
+
+  int32_t sizes[2];
+  std::memcpy(sizes, file.getData() + kConnectionCostMagicSize, sizeof(sizes));
+  if (sizes[0] <= 0 || sizes[1] <= 0 ||
+      file.getSize() !=
+          headerSize + sizeof(int32_t) * static_cast<size_t>(sizes[0]) *
+                           static_cast<size_t>(sizes[1]))
+    return absl::InvalidArgumentError(
+        absl::StrCat("Malformed binary connection cost file ", path));
+
+  auto* costLists = connectionCost->mutable_cost_lists();
+  costLists->Resize(sizes[0] * sizes[1], 0);
+  std::memcpy(costLists->mutable_data(), file.getData() + headerSize,
+              file.getSize() - headerSize);
+  connectionCost->set_forward_size(sizes[0]);
+  connectionCost->set_backward_size(sizes[1]);
+
+  return absl::OkStatus();
+}
+
+absl::Status hashFiles(const std::vector<std::string>& paths,
+                       absl::string_view salt, std::string& key) {
+  // 64-bit FNV-1a
+  uint64_t hash = 14695981039346656037ULL;
+  const auto update = [&hash](const char* data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+      hash ^= static_cast<unsigned char>(data[i]);
+      hash *= 1099511628211ULL;
+    }
+  };
+
+  update(salt.data(), salt.size());
+  for (const auto& path : paths) {
+    utils::internal::MappedFile file;
+    auto status = file.open(path);
+    if (!status.ok()) return status;
+
+    const uint64_t size = file.getSize();
+    update(reinterpret_cast<const char*>(&size), sizeof(size));
+    update(file.getData(), file.getSize());
+  }
+
+  key = absl::StrCat(absl::Hex(hash, absl::kZeroPad16));
+  return absl::OkStatus();
+}
+
+// Read and parse the csv file, and convert all rows to morphemes.
+absl::Status parseMeCabCSVFile(const std::string& path, bool normalize,
+                               const std::string& normalizationForm,
+                               nori::protos::CSVFileCache& output) {
+  CSVFile file;
+  auto status = readMeCabCSVFile(path, normalize, normalizationForm, file);
+  if (!status.ok()) return status;
+
+  output.mutable_surfaces()->Reserve(file.rows.size());
+  output.mutable_morphemes()->Reserve(file.rows.size());
+  for (const auto& row : file.rows) {
+    output.add_surfaces(row[0].data(), row[0].size());
+    status = convertMeCabCSVEntry(row, output.add_morphemes());
+    if (!status.ok()) return status;
+  }
+  return absl::OkStatus();
+}
+
+// Bump this when the cached intermediates change.
+constexpr char kCacheVersion[] = "1";
+
+absl::Status loadCachedMessage(const std::string& path,
+                               google::protobuf::Message* message) {
+  std::ifstream ifs(path, std::ios::in | std::ios::binary);
+  if (ifs.fail())
+    return absl::NotFoundError(absl::StrCat("Cannot open file ", path));
+
+  if (!message->ParseFromIstream(&ifs)) {
+    message->Clear();
+    return absl::InternalError(absl::StrCat("Cannot parse file ", path));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status saveCachedMessage(const std::string& path,
+                               const google::protobuf::Message& message) {
+  std::ofstream ofs(path, std::ios::out | std::ios::binary);
+  if (ofs.fail() || !message.SerializeToOstream(&ofs))
+    return absl::InternalError(absl::StrCat("Cannot write file ", path));
+  return absl::OkStatus();
+}
+
+// Load the result of `build` from the cache file of `sources`, or run `build`
+// and write the cache file. The cache file is written to a temporary path and
+// renamed, so concurrent builds never read a partial cache file.
+template <class Load, class Build, class Save>
+absl::Status buildWithCache(absl::string_view cacheDirectory,
+                            absl::string_view name,
+                            const std::vector<std::string>& sources,
+                            absl::string_view salt, Load load, Build build,
+                            Save save) {
+  if (cacheDirectory.empty()) return build();
+
+  std::string key;
+  // missing sources are reported by `build`.
+  if (!hashFiles(sources, absl::StrCat(kCacheVersion, ":", salt), key).ok())
+    return build();
+
+  const auto path = utils::internal::joinPath(
+      cacheDirectory, absl::StrCat(name, "-", key, ".cache"));
+  if (load(path).ok()) {
+    LOG(INFO) << "Reuse " << path;
+    return absl::OkStatus();
+  }
+
+  auto status = build();
+  if (!status.ok()) return status;
+
+  // the same sources can be built concurrently, e.g. duplicated csv files.
+  static std::atomic<int> nextTemporaryId(0);
+  const auto temporaryPath =
+      absl::StrCat(path, ".", getpid(), "-", nextTemporaryId++, ".tmp");
+  status = save(temporaryPath);
+  if (status.ok() && std::rename(temporaryPath.c_str(), path.c_str()) != 0)
+    status = absl::InternalError(absl::StrCat("Cannot rename to ", path));
+  if (!status.ok()) {
+    std::remove(temporaryPath.c_str());
+    LOG(WARNING) << "Cannot write cache: " << status.message();
+  }
+  return absl::OkStatus();
+}
+
+// Temporary file that is removed on destruction.
+class TemporaryFile {
+ public:
+  TemporaryFile() = default;
+  TemporaryFile(const TemporaryFile&) = delete;
+  TemporaryFile& operator=(const TemporaryFile&) = delete;
+  ~TemporaryFile() {
+    if (!path.empty()) std::remove(path.c_str());
+  }
+
+  absl::Status create(absl::string_view directory) {
+    std::string pattern =
+        utils::internal::joinPath(directory, "nori-builder-XXXXXX");
+    int fd = mkstemp(&pattern[0]);
+    if (fd == -1)
+      return absl::InternalError(
+          absl::StrCat("Cannot create temporary file in ", directory));
+    close(fd);
+
+    path = pattern;
+    return absl::OkStatus();
+  }
+
+  const std::string& getPath() const { return path; }
+
+ private:
+  std::string path;
+};
+
+// A row of MeCab's csv file and its trimmed surface.
+struct CSVRow {
+  std::string surface;
+  std::string line;
+};
+
+// Read buffer size of a sorted run, and the maximum number of runs merged at
+// once. The fan-in is bounded to keep open files and read buffers within the
+// memory budget.
+constexpr size_t kSortedRunBufferSize = 1 << 16;
+constexpr size_t kMaxMergeFanIn = 256;
+
+size_t getMergeFanIn(size_t memoryBudget) {
+  return std::min(
+      kMaxMergeFanIn,
+      std::max<size_t>(2, memoryBudget / 2 / kSortedRunBufferSize));
+}
+
+// Sorted run of the external merge sort.
+//
+// Each record is stored as (surface length, surface, line length, line).
+class SortedRunReader {
+ public:
+  absl::Status open(const std::string& path) {
+    buffer.resize(kSortedRunBufferSize);
+    ifs.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+    ifs.open(path, std::ios::in | std::ios::binary);
+    if (ifs.fail())
+      return absl::InternalError(absl::StrCat("Cannot open sorted run ", path));
+    return absl::OkStatus();
+  }
+
+  // read the next row. return false at the end of the run.
+  bool next() { return readString(row.surface) && readString(row.line); }
+
+  const CSVRow& getRow() const { return row; }
+
+ private:
+  bool readString(std::string& output) {
+    uint32_t length;
+    if (!ifs.read(reinterpret_cast<char*>(&length), sizeof(length)))
+      return false;
+    output.resize(length);
+    return static_cast<bool>(ifs.read(&output[0], length));
+  }
+
+  std::vector<char> buffer;
+  std::ifstream ifs;
+  CSVRow row;
+};
+
+void writeSortedRunRow(std::ofstream& ofs, const CSVRow& row) {
+  for (const std::string* value : {&row.surface, &row.line}) {
+    const uint32_t length = value->size();
+    ofs.write(reinterpret_cast<const char*>(&length), sizeof(length));
+    ofs.write(value->data(), length);
+  }
+}
+
+absl::Status writeSortedRun(std::vector<CSVRow>& rows,
+                            const std::string& path) {
+  std::stable_sort(rows.begin(), rows.end(),
+                   [](const CSVRow& a, const CSVRow& b) {
+                     return a.surface < b.surface;
+                   });
+
+  std::ofstream ofs(path, std::ios::out | std::ios::binary);
+  if (ofs.fail())
+    return absl::InternalError(absl::StrCat("Cannot open sorted run ", path));
+
+  for (const auto& row : rows) writeSortedRunRow(ofs, row);
+  ofs.close();
+  if (ofs.fail())
+    return absl::InternalError(absl::StrCat("Cannot write sorted run ", path));
+  return absl::OkStatus();
+}
+
+// Merge runs [begin, end) of `runFiles` and call `onRow` for each row in the
+// order of (surface, run index). The run index keeps the order of rows with
+// the same surface as the input order.
+template <class OnRow>
+absl::Status mergeSortedRuns(
+    const std::vector<std::unique_ptr<TemporaryFile>>& runFiles, size_t begin,
+    size_t end, OnRow onRow) {
+  std::vector<std::unique_ptr<SortedRunReader>> runs;
+  for (size_t i = begin; i < end; i++) {
+    runs.emplace_back(new SortedRunReader);
+    auto status = runs.back()->open(runFiles[i]->getPath());
+    if (!status.ok()) return status;
+  }
+
+  const auto greater = [&runs](int a, int b) {
+    const auto& surfaceA = runs[a]->getRow().surface;
+    const auto& surfaceB = runs[b]->getRow().surface;
+    if (surfaceA != surfaceB) return surfaceA > surfaceB;
+    return a > b;
+  };
+  std::priority_queue<int, std::vector<int>, decltype(greater)> heap(greater);
+  for (int i = 0; i < runs.size(); i++) {
+    if (runs[i]->next()) heap.push(i);
+  }
+
+  while (!heap.empty()) {
+    const int runIndex = heap.top();
+    heap.pop();
+    auto status = onRow(runs[runIndex]->getRow());
+    if (!status.ok()) return status;
+    if (runs[runIndex]->next()) heap.push(runIndex);
+  }
+  return absl::OkStatus();
+}
+
+// Merge adjacent groups of at most `fanIn` runs into intermediate runs until
+// at most `fanIn` runs remain.
+absl::Status reduceSortedRuns(
+    std::vector<std::unique_ptr<TemporaryFile>>& runFiles, size_t fanIn,
+    absl::string_view temporaryDirectory) {
+  while (runFiles.size() > fanIn) {
+    std::vector<std::unique_ptr<TemporaryFile>> merged;
+    for (size_t begin = 0; begin < runFiles.size(); begin += fanIn) {
+      const size_t end = std::min(begin + fanIn, runFiles.size());
+      if (end - begin == 1) {
+        merged.push_back(std::move(runFiles[begin]));
+        continue;
+      }
+
+      merged.emplace_back(new TemporaryFile);
+      auto status = merged.back()->create(temporaryDirectory);
+      if (!status.ok()) return status;
+      const std::string& path = merged.back()->getPath();
+      std::ofstream ofs(path, std::ios::out | std::ios::binary);
+      if (ofs.fail())
+        return absl::InternalError(
+            absl::StrCat("Cannot open sorted run ", path));
+
+      status = mergeSortedRuns(runFiles, begin, end, [&](const CSVRow& row) {
+        writeSortedRunRow(ofs, row);
+        return absl::OkStatus();
+      });
+      if (!status.ok()) return status;
+      ofs.close();
+      if (ofs.fail())
+        return absl::InternalError(
+            absl::StrCat("Cannot write sorted run ", path));
+    }
+    runFiles = std::move(merged);
+    LOG(INFO) << "Merged sorted runs into " << runFiles.size() << " runs";
+  }
+  return absl::OkStatus();
+}
+
+// snappy::Source reading a file chunk by chunk.
+class FileSource : public snappy::Source {
+ public:
+  FileSource(std::ifstream& ifs, size_t size)
+      : ifs(ifs), remaining(size), buffer(1 << 16), begin(0), end(0) {}
+
+  size_t Available() const override { return remaining; }
+
+  const char* Peek(size_t* length) override {
+    if (begin == end && remaining != 0) {
+      ifs.read(buffer.data(), std::min(buffer.size(), remaining));
+      begin = 0;
+      end = ifs.gcount();
+    }
+    *length = end - begin;
+    return buffer.data() + begin;
+  }
+
+  void Skip(size_t n) override {
+    begin += n;
+    remaining -= n;
+  }
+
+ private:
+  std::ifstream& ifs;
+  size_t remaining;
+  std::vector<char> buffer;
+  size_t begin, end;
+};
+
+// snappy::Sink writing to a file.
+class FileSink : public snappy::Sink {
+ public:
+  explicit FileSink(std::ofstream& ofs) : ofs(ofs) {}
+
+  void Append(const char* bytes, size_t n) override { ofs.write(bytes, n); }
+
+ private:
+  std::ofstream& ofs;
+};
+
+// compress the file `inputPath` with snappy and save it to `outputPath`
+absl::Status compressFile(const std::string& inputPath,
+                          const std::string& outputPath) {
+  std::ifstream ifs(inputPath, std::ios::in | std::ios::binary | std::ios::ate);
+  if (ifs.fail())
+    return absl::InternalError(absl::StrCat("Cannot open file ", inputPath));
+  const size_t size = ifs.tellg();
+  ifs.seekg(0);
+
+  std::ofstream ofs(outputPath, std::ios::out | std::ios::binary);
+  if (ofs.fail())
+    return absl::InvalidArgumentError(
+        absl::StrCat("Cannot open file ", outputPath));
+
+  FileSource source(ifs, size);
+  FileSink sink(ofs);
+  snappy::Compress(&source, &sink);
+
+  ofs.close();
+  if (ofs.fail() || ifs.fail())
+    return absl::InternalError(absl::StrCat("Cannot compress ", inputPath));
+  return absl::OkStatus();
+}
+
 }  // namespace internal
 
 // DictionaryBuilder
 
-absl::Status DictionaryBuilder::build(absl::string_view inputDirectory) {
+absl::Status DictionaryBuilder::build(absl::string_view inputDirectory,
+                                      absl::string_view cacheDirectory) {
+  const auto start = std::chrono::steady_clock::now();
   absl::Status status;
 
   noriDictionary.set_do_normalize(normalize);
@@ -86,15 +645,67 @@ absl::Status DictionaryBuilder::build(absl::string_view inputDirectory) {
     noriDictionary.set_normalization_form(normalizationForm);
   }
 
-  status = this->buildTokenInfos(inputDirectory);
+  // unk.def, char.def, matrix.def and id files don't depend on csv files.
+  // Build them in the background while building token infos.
+  const auto policy = internal::resolveNumThreads(numThreads) > 1
+                          ? std::launch::async
+                          : std::launch::deferred;
+  nori::protos::UnknownTokens unknownTokens;
+  nori::protos::ConnectionCost connectionCost;
+  nori::protos::Dictionary leftRightIds;
+  auto unknownTokensFuture = std::async(policy, [&]() {
+    return internal::buildWithCache(
+        cacheDirectory, "unk",
+        {utils::internal::joinPath(inputDirectory, "unk.def"),
+         utils::internal::joinPath(inputDirectory, "char.def")},
+        "",
+        [&](const std::string& path) {
+          return internal::loadCachedMessage(path, &unknownTokens);
+        },
+        [&]() {
+          return this->buildUnknownTokenInfos(inputDirectory, &unknownTokens);
+        },
+        [&](const std::string& path) {
+          return internal::saveCachedMessage(path, unknownTokens);
+        });
+  });
+  auto connectionCostFuture = std::async(policy, [&]() {
+    return internal::buildWithCache(
+        cacheDirectory, "matrix",
+        {utils::internal::joinPath(inputDirectory, "matrix.def")}, "",
+        [&](const std::string& path) {
+          return internal::loadBinaryConnectionCost(path, &connectionCost);
+        },
+        [&]() {
+          return this->buildConnectionCost(inputDirectory, &connectionCost);
+        },
+        [&](const std::string& path) {
+          return internal::saveBinaryConnectionCost(path, connectionCost);
+        });
+  });
+  auto leftRightIdsFuture = std::async(policy, [&]() {
+    return this->findLeftRightIds(inputDirectory, &leftRightIds);
+  });
+
+  status = this->buildTokenInfos(inputDirectory, cacheDirectory);
   if (!status.ok()) return status;
-  status = this->buildUnknownTokenInfos(inputDirectory);
+
+  status = unknownTokensFuture.get();
   if (!status.ok()) return status;
-  status = this->buildConnectionCost(inputDirectory);
+  noriDictionary.mutable_unknown_tokens()->Swap(&unknownTokens);
+
+  status = connectionCostFuture.get();
   if (!status.ok()) return status;
-  status = this->findLeftRightIds(inputDirectory);
+  noriDictionary.mutable_connection_cost()->Swap(&connectionCost);
+
+  status = leftRightIdsFuture.get();
   if (!status.ok()) return status;
+  noriDictionary.set_left_id_nng(leftRightIds.left_id_nng());
+  noriDictionary.set_right_id_nng(leftRightIds.right_id_nng());
+  noriDictionary.set_right_id_nng_t(leftRightIds.right_id_nng_t());
+  noriDictionary.set_right_id_nng_f(leftRightIds.right_id_nng_f());
 
+  LOG(INFO) << "Built dictionary in " << internal::elapsedMs(start) << "ms";
   return absl::OkStatus();
 }
 
@@ -102,8 +713,43 @@ absl::Status DictionaryBuilder::save(std::string outputFilename) {
   return internal::serializeCompressedProtobuf(outputFilename, noriDictionary);
 }
 
-absl::Status DictionaryBuilder::buildTokenInfos(absl::string_view input) {
-  // 1. Read all csvs
+absl::Status DictionaryBuilder::loadPrebuilt(std::string filename) {
+  return dictionary::internal::deserializeProtobuf(filename, noriDictionary);
+}
+
+absl::Status DictionaryBuilder::importConnectionCost(std::string filename) {
+  nori::protos::ConnectionCost connectionCost;
+  auto status = internal::loadBinaryConnectionCost(filename, &connectionCost);
+  if (!status.ok()) return status;
+
+  // left and right ids of the dictionary index the matrix.
+  const auto& current = noriDictionary.connection_cost();
+  if (connectionCost.forward_size() != current.forward_size() ||
+      connectionCost.backward_size() != current.backward_size())
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Size of connection cost ", connectionCost.forward_size(), "x",
+        connectionCost.backward_size(), " is different from the dictionary ",
+        current.forward_size(), "x", current.backward_size()));
+
+  noriDictionary.mutable_connection_cost()->Swap(&connectionCost);
+  return absl::OkStatus();
+}
+
+absl::Status DictionaryBuilder::exportConnectionCost(
+    std::string filename) const {
+  return internal::saveBinaryConnectionCost(filename,
+                                            noriDictionary.connection_cost());
+}
+
+absl::Status DictionaryBuilder::buildStreaming(
+    absl::string_view input, std::string outputFilename, size_t memoryBudget,
+    absl::string_view temporaryDirectory) {
+  const auto start = std::chrono::steady_clock::now();
+
+  // 1. Read all csvs and write sorted runs.
+  //
+  // Half of the budget is for rows, and the rest is for the sort and the
+  // protobuf messages.
   std::vector<std::string> paths;
   utils::internal::listDirectory(input, paths, [](absl::string_view path) {
     return absl::EndsWithIgnoreCase(path, ".csv");
@@ -112,89 +758,323 @@ absl::Status DictionaryBuilder::buildTokenInfos(absl::string_view input) {
     return absl::InvalidArgumentError(
         absl::StrCat("Cannot find any csv files, ", input));
 
-  std::vector<std::vector<std::string>> entries;
-  entries.reserve(1000000);
+  const size_t runBudget = memoryBudget / 2;
+  std::vector<std::unique_ptr<internal::TemporaryFile>> runFiles;
+  std::vector<internal::CSVRow> rows;
+  size_t rowBytes = 0, numRows = 0;
+
+  const auto spill = [&]() -> absl::Status {
+    if (rows.size() == 0) return absl::OkStatus();
+
+    runFiles.emplace_back(new internal::TemporaryFile);
+    auto status = runFiles.back()->create(temporaryDirectory);
+    if (!status.ok()) return status;
+    status = internal::writeSortedRun(rows, runFiles.back()->getPath());
+    if (!status.ok()) return status;
+
+    rows.clear();
+    rows.shrink_to_fit();
+    rowBytes = 0;
+    return absl::OkStatus();
+  };
 
-  // 2. read csv files and append all rows into entries.
   for (const auto& path : paths) {
     std::ifstream ifs(path);
     if (ifs.fail())
       return absl::InvalidArgumentError(absl::StrCat(path, " is missing"));
 
     std::string line;
+    std::vector<absl::string_view> entry;
     while (std::getline(ifs, line)) {
-      // normalize the line if required
       if (normalize) {
         std::string normalized;
         auto status =
             utils::internal::normalizeUTF8(line, normalized, normalizationForm);
-        if (!status.ok()) {
-          ifs.close();
+        if (!status.ok())
           return absl::InternalError(
               absl::StrCat("Cannot normalize string", line));
-        }
-        line = normalized;
+        line.swap(normalized);
       }
-      auto entry = utils::internal::parseCSVLine(line);
 
+      entry.clear();
+      utils::internal::parseCSVLine(absl::string_view(line), entry);
       if (entry.size() < 12) {
-        ifs.close();
         return absl::InvalidArgumentError(absl::StrCat(
             "Entry in CSV is not valid (12 field values expected): ", line));
       }
-      utils::internal::trimWhitespaces(entry[0]);
 
-      entries.push_back(entry);
+      internal::CSVRow row;
+      row.surface = std::string(absl::StripAsciiWhitespace(entry[0]));
+      row.line = std::move(line);
+      rowBytes += sizeof(row) + row.surface.capacity() + row.line.capacity();
+      rows.push_back(std::move(row));
+      numRows++;
+
+      if (rowBytes >= runBudget) {
+        auto status = spill();
+        if (!status.ok()) return status;
+      }
     }
     ifs.close();
-    LOG(INFO) << "Read " << path << ". # terms: " << entries.size();
+    LOG(INFO) << "Read " << path << ". # terms: " << numRows;
   }
+  auto status = spill();
+  if (!status.ok()) return status;
+  LOG(INFO) << "Wrote " << runFiles.size() << " sorted runs in "
+            << internal::elapsedMs(start) << "ms";
+
+  // Merge passes keep at most half of the budget in read buffers of runs, and
+  // the number of open runs is bounded as well.
+  status = internal::reduceSortedRuns(
+      runFiles, internal::getMergeFanIn(memoryBudget), temporaryDirectory);
+  if (!status.ok()) return status;
+
+  // 2. Merge sorted runs and stream morphemes into the protobuf file.
+  //
+  // Serialized protobuf messages can be concatenated, and the parser merges
+  // them. So the dictionary is written as a sequence of partial messages, and
+  // morphemes lists are appended to `tokens` one by one.
+  internal::TemporaryFile protobufFile;
+  status = protobufFile.create(temporaryDirectory);
+  if (!status.ok()) return status;
+
+  std::ofstream ofs(protobufFile.getPath(), std::ios::out | std::ios::binary);
+  if (ofs.fail())
+    return absl::InternalError(
+        absl::StrCat("Cannot open file ", protobufFile.getPath()));
+
+  std::string keyBuffer;
+  std::vector<size_t> keyOffsets;
+  {
+    google::protobuf::io::OstreamOutputStream outputStream(&ofs);
+    google::protobuf::io::CodedOutputStream codedStream(&outputStream);
+    nori::protos::Dictionary chunk;
+    const auto writeChunk = [&]() -> absl::Status {
+      if (!chunk.SerializeToCodedStream(&codedStream))
+        return absl::InternalError("Cannot serialize dictionary");
+      chunk.Clear();
+      return absl::OkStatus();
+    };
+
+    nori::protos::MorphemeList* lastMorphemeList = nullptr;
+    std::vector<absl::string_view> entry;
+    status = internal::mergeSortedRuns(
+        runFiles, 0, runFiles.size(),
+        [&](const internal::CSVRow& row) -> absl::Status {
+          if (lastMorphemeList == nullptr ||
+              absl::string_view(keyBuffer).substr(keyOffsets.back()) !=
+                  row.surface) {
+            if (lastMorphemeList != nullptr) {
+              auto status = writeChunk();
+              if (!status.ok()) return status;
+            }
+            keyOffsets.push_back(keyBuffer.size());
+            keyBuffer.append(row.surface);
+            lastMorphemeList = chunk.mutable_tokens()->add_morphemes_list();
+          }
+
+          entry.clear();
+          utils::internal::parseCSVLine(absl::string_view(row.line), entry);
+          return internal::convertMeCabCSVEntry(
+              entry, lastMorphemeList->add_morphemes());
+        });
+    if (!status.ok()) return status;
+    if (lastMorphemeList != nullptr) {
+      status = writeChunk();
+      if (!status.ok()) return status;
+    }
+    runFiles.clear();
+    LOG(INFO) << "Merged " << numRows << " terms into " << keyOffsets.size()
+              << " keys in " << internal::elapsedMs(start) << "ms";
+
+    // 3. Build trie
+    if (keyOffsets.size() == 0)
+      return absl::InvalidArgumentError(
+          absl::StrCat("Cannot find any terms, ", input));
+
+    std::vector<absl::string_view> keys(keyOffsets.size());
+    for (int i = 0; i < keyOffsets.size(); i++) {
+      const size_t keyEnd = i + 1 == keyOffsets.size() ? keyBuffer.size()
+                                                       : keyOffsets[i + 1];
+      keys[i] = absl::string_view(keyBuffer.data() + keyOffsets[i],
+                                  keyEnd - keyOffsets[i]);
+    }
+
+    {
+      Darts::DoubleArray trie;
+      status = dictionary::internal::buildTrie(keys, keyEncoding, trie);
+      if (!status.ok()) return status;
+
+      chunk.mutable_darts_array()->assign(
+          static_cast<const char*>(trie.array()), trie.total_size());
+      internal::buildFirstCodePoints(keys, chunk.mutable_first_code_points());
+      chunk.set_key_encoding(keyEncoding);
+    }
+    status = writeChunk();
+    if (!status.ok()) return status;
+    LOG(INFO) << "Built trie in " << internal::elapsedMs(start) << "ms";
+
+    if (withAhoCorasick) {
+      status = dictionary::internal::buildAhoCorasick(
+          keys, chunk.mutable_aho_corasick());
+      if (!status.ok()) return status;
+      status = writeChunk();
+      if (!status.ok()) return status;
+      LOG(INFO) << "Built Aho-Corasick automaton in "
+                << internal::elapsedMs(start) << "ms";
+    }
+
+    // 4. Write the rest of the dictionary
+    status =
+        this->buildUnknownTokenInfos(input, chunk.mutable_unknown_tokens());
+    if (!status.ok()) return status;
+    status = writeChunk();
+    if (!status.ok()) return status;
+
+    status = this->buildConnectionCost(input, chunk.mutable_connection_cost());
+    if (!status.ok()) return status;
+    status = writeChunk();
+    if (!status.ok()) return status;
+
+    status = this->findLeftRightIds(input, &chunk);
+    if (!status.ok()) return status;
+    chunk.set_do_normalize(normalize);
+    if (normalize) {
+      chunk.set_normalization_form(normalizationForm);
+    }
+    status = writeChunk();
+    if (!status.ok()) return status;
+  }
+  ofs.close();
+  if (ofs.fail())
+    return absl::InternalError(
+        absl::StrCat("Cannot write file ", protobufFile.getPath()));
+
+  // 5. Compress
+  status = internal::compressFile(protobufFile.getPath(), outputFilename);
+  if (!status.ok()) return status;
+
+  LOG(INFO) << "Built dictionary in " << internal::elapsedMs(start) << "ms";
+  return absl::OkStatus();
+}
+
+absl::Status DictionaryBuilder::buildTokenInfos(
+    absl::string_view input, absl::string_view cacheDirectory) {
+  auto start = std::chrono::steady_clock::now();
+
+  // 1. Read all csvs
+  std::vector<std::string> paths;
+  utils::internal::listDirectory(input, paths, [](absl::string_view path) {
+    return absl::EndsWithIgnoreCase(path, ".csv");
+  });
+  if (paths.size() == 0)
+    return absl::InvalidArgumentError(
+        absl::StrCat("Cannot find any csv files, ", input));
+
+  // 2. read, normalize, parse and convert csv files concurrently. Unchanged
+  // files are loaded from the cache.
+  const std::string salt = normalize ? normalizationForm : "";
+  std::vector<nori::protos::CSVFileCache> files(paths.size());
+  {
+    std::vector<absl::Status> statuses(paths.size());
+    std::atomic<size_t> nextIndex(0);
+    const auto worker = [&]() {
+      for (size_t i = nextIndex++; i < paths.size(); i = nextIndex++) {
+        statuses[i] = internal::buildWithCache(
+            cacheDirectory, "csv", {paths[i]}, salt,
+            [&](const std::string& path) {
+              return internal::loadCachedMessage(path, &files[i]);
+            },
+            [&]() {
+              return internal::parseMeCabCSVFile(paths[i], normalize,
+                                                 normalizationForm, files[i]);
+            },
+            [&](const std::string& path) {
+              return internal::saveCachedMessage(path, files[i]);
+            });
+      }
+    };
+
+    const int numWorkers = std::min(internal::resolveNumThreads(numThreads),
+                                    static_cast<int>(paths.size()));
+    std::vector<std::thread> workers;
+    for (int i = 1; i < numWorkers; i++) workers.emplace_back(worker);
+    worker();
+    for (auto& thread : workers) thread.join();
+
+    for (const auto& status : statuses) {
+      if (!status.ok()) return status;
+    }
+  }
+
+  size_t numEntries = 0;
+  for (int i = 0; i < paths.size(); i++) {
+    if (files[i].surfaces_size() != files[i].morphemes_size())
+      return absl::InternalError(
+          absl::StrCat("Broken entries of csv file ", paths[i]));
+
+    LOG(INFO) << "Read " << paths[i]
+              << ". # terms: " << files[i].surfaces_size();
+    numEntries += files[i].surfaces_size();
+  }
+
+  struct Entry {
+    absl::string_view surface;
+    nori::protos::Morpheme* morpheme;
+  };
+  std::vector<Entry> entries;
+  entries.reserve(numEntries);
+  for (auto& file : files) {
+    for (int i = 0; i < file.surfaces_size(); i++) {
+      entries.push_back({file.surfaces(i), file.mutable_morphemes(i)});
+    }
+  }
+  LOG(INFO) << "Read " << numEntries << " terms from " << paths.size()
+            << " csv files in " << internal::elapsedMs(start) << "ms";
 
   // 3. prepare building trie dictionary and add token infos
+  start = std::chrono::steady_clock::now();
   std::stable_sort(
       entries.begin(), entries.end(),
-      [](const std::vector<std::string> a, const std::vector<std::string> b) {
-        return a[0] < b[0];
-      });
+      [](const Entry& a, const Entry& b) { return a.surface < b.surface; });
 
-  std::vector<const char*> keys;
+  std::vector<absl::string_view> keys;
   keys.reserve(entries.size());
 
-  std::string lastValue = "";
-  int entryValue = -1;
   nori::protos::MorphemeList* lastMorphemeList;
 
   for (int i = 0; i < entries.size(); i++) {
-    if (entries[i][0] != lastValue) {
-      keys.push_back(entries[i][0].c_str());
-      lastValue = entries[i][0];
-      entryValue++;
+    if (i == 0 || entries[i].surface != entries[i - 1].surface) {
+      keys.push_back(entries[i].surface);
       lastMorphemeList = noriDictionary.mutable_tokens()->add_morphemes_list();
     }
 
-    auto status = internal::convertMeCabCSVEntry(
-        entries[i], lastMorphemeList->add_morphemes());
-    if (!status.ok()) return status;
+    lastMorphemeList->add_morphemes()->Swap(entries[i].morpheme);
   }
+  LOG(INFO) << "Sorted terms in " << internal::elapsedMs(start) << "ms";
 
   // 4. Build tries
-  LOG(INFO) << "Build trie. keys[0]: " << keys[0] << ", keys[10]: " << keys[10];
+  start = std::chrono::steady_clock::now();
+  LOG(INFO) << "Build trie. # keys: " << keys.size();
   std::unique_ptr<Darts::DoubleArray> trie =
       std::unique_ptr<Darts::DoubleArray>(new Darts::DoubleArray);
-  if (trie->build(keys.size(), const_cast<char**>(&keys[0])) != 0)
-    return absl::InternalError("Cannot build trie.");
+  auto status = dictionary::internal::buildTrie(keys, keyEncoding, *trie);
+  if (!status.ok()) return status;
 
   noriDictionary.mutable_darts_array()->assign(
       static_cast<const char*>(trie->array()), trie->total_size());
-
-  trie->set_array(noriDictionary.darts_array().data(),
-                  noriDictionary.darts_array().size());
-
-  int searchResult;
-  for (int i = 0; i < keys.size(); i++) {
-    trie->exactMatchSearch(keys[i], searchResult);
-    if (searchResult != i)
-      return absl::InternalError("Trie isn't built properly.");
+  internal::buildFirstCodePoints(keys,
+                                 noriDictionary.mutable_first_code_points());
+  noriDictionary.set_key_encoding(keyEncoding);
+  LOG(INFO) << "Built trie in " << internal::elapsedMs(start) << "ms";
+
+  if (withAhoCorasick) {
+    start = std::chrono::steady_clock::now();
+    status = dictionary::internal::buildAhoCorasick(
+        keys, noriDictionary.mutable_aho_corasick());
+    if (!status.ok()) return status;
+    LOG(INFO) << "Built Aho-Corasick automaton in "
+              << internal::elapsedMs(start) << "ms";
   }
 
   return absl::OkStatus();
@@ -203,7 +1083,9 @@ absl::Status DictionaryBuilder::buildTokenInfos(absl::string_view input) {
 // UnknownDictionaryBuilder class
 
 absl::Status DictionaryBuilder::buildUnknownTokenInfos(
-    absl::string_view input) {
+    absl::string_view input, nori::protos::UnknownTokens* unknownTokens) const {
+  const auto start = std::chrono::steady_clock::now();
+
   // Build unk.def
   {
     const auto path = utils::internal::joinPath(input, "unk.def");
@@ -212,8 +1094,7 @@ absl::Status DictionaryBuilder::buildUnknownTokenInfos(
     if (ifs.fail())
       return absl::InvalidArgumentError(absl::StrCat(path, " is missing"));
 
-    auto* morphemeMap =
-        noriDictionary.mutable_unknown_tokens()->mutable_morpheme_map();
+    auto* morphemeMap = unknownTokens->mutable_morpheme_map();
     std::vector<std::vector<std::string>> allLines;
     const auto append = [&morphemeMap](std::string line) -> absl::Status {
       std::vector<std::string> entry = utils::internal::parseCSVLine(line);
@@ -256,46 +1137,43 @@ absl::Status DictionaryBuilder::buildUnknownTokenInfos(
       return absl::InvalidArgumentError(absl::StrCat(path, " is missing"));
 
     std::string line;
-    std::regex spaceRegex("\\s+");
-    std::regex commentRegex("\\s*#.*");
-    auto* invokeMap =
-        noriDictionary.mutable_unknown_tokens()->mutable_invoke_map();
-    auto* codeToCategoryMap =
-        noriDictionary.mutable_unknown_tokens()->mutable_code_to_category_map();
+    auto* invokeMap = unknownTokens->mutable_invoke_map();
+    auto* codeToCategoryMap = unknownTokens->mutable_code_to_category_map();
 
     while (std::getline(ifs, line)) {
-      if (absl::StartsWith(line, "#")) continue;  // skip comments
-      utils::internal::trimWhitespaces(line);
-      if (line.length() == 0) continue;  // skip empty line
-
-      // remove comments
-      line = std::regex_replace(line, commentRegex, "");
-      line = std::regex_replace(line, spaceRegex, " ");
-
-      if (!absl::StartsWith(line, "0x")) {
+      // remove comments and split by whitespaces
+      absl::string_view content = line;
+      content = content.substr(0, content.find('#'));
+      std::vector<absl::string_view> tokens = absl::StrSplit(
+          content, absl::ByAnyChar(" \t\r\v\f"), absl::SkipEmpty());
+      if (tokens.size() == 0) continue;  // skip empty line
+
+      if (!absl::StartsWith(tokens[0], "0x")) {
         // char category definition
-        std::vector<std::string> splits = absl::StrSplit(line, " ");
         nori::protos::CharacterClass chCls;
-        if (!nori::protos::CharacterClass_Parse(splits[0], &chCls)) {
+        if (tokens.size() < 4 ||
+            !nori::protos::CharacterClass_Parse(std::string(tokens[0]),
+                                                &chCls)) {
           ifs.close();
           return absl::InvalidArgumentError(
-              absl::StrCat("Cannot read character class ", splits[0]));
+              absl::StrCat("Cannot read character class ", tokens[0]));
         }
-        (*invokeMap)[chCls].set_invoke(utils::internal::simpleAtoi(splits[1]));
-        (*invokeMap)[chCls].set_group(utils::internal::simpleAtoi(splits[2]));
-        (*invokeMap)[chCls].set_length(utils::internal::simpleAtoi(splits[3]));
+        (*invokeMap)[chCls].set_invoke(utils::internal::simpleAtoi(tokens[1]));
+        (*invokeMap)[chCls].set_group(utils::internal::simpleAtoi(tokens[2]));
+        (*invokeMap)[chCls].set_length(utils::internal::simpleAtoi(tokens[3]));
       } else {
-        std::vector<std::string> tokens = absl::StrSplit(line, " ");
-
         nori::protos::CharacterClass chCls;
-        if (!nori::protos::CharacterClass_Parse(tokens[1], &chCls)) {
+        if (tokens.size() < 2 ||
+            !nori::protos::CharacterClass_Parse(std::string(tokens[1]),
+                                                &chCls)) {
           ifs.close();
           return absl::InvalidArgumentError(
-              absl::StrCat("Cannot read character class ", tokens[1]));
+              absl::StrCat("Cannot read character class ", line));
         }
 
         if (absl::StrContains(tokens[0], "..")) {
-          std::vector<std::string> codePoints = absl::StrSplit(tokens[0], "..");
+          std::vector<absl::string_view> codePoints =
+              absl::StrSplit(tokens[0], "..");
           int codePointFrom = utils::internal::simpleHexAtoi(codePoints[0]);
           int codePointTo = utils::internal::simpleHexAtoi(codePoints[1]);
 
@@ -310,58 +1188,80 @@ absl::Status DictionaryBuilder::buildUnknownTokenInfos(
     ifs.close();
   }
 
+  LOG(INFO) << "Built unknown token infos in " << internal::elapsedMs(start)
+            << "ms";
   return absl::OkStatus();
 }
 
-absl::Status DictionaryBuilder::buildConnectionCost(absl::string_view input) {
+absl::Status DictionaryBuilder::buildConnectionCost(
+    absl::string_view input,
+    nori::protos::ConnectionCost* connectionCost) const {
+  const auto start = std::chrono::steady_clock::now();
   const auto path = utils::internal::joinPath(input, "matrix.def");
   LOG(INFO) << "Read connection costs (matrix.def) " << path;
-  std::ifstream ifs(path);
-  if (ifs.fail())
+  utils::internal::MappedFile file;
+  if (!file.open(path).ok())
     return absl::InvalidArgumentError(absl::StrCat(path, " is missing"));
 
-  std::string line;
-  std::getline(ifs, line);
-  std::vector<std::string> dimensions = absl::StrSplit(line, " ");
-  if (dimensions.size() != 2) {
-    ifs.close();
-    return absl::InvalidArgumentError("Malformed matrix.def");
-  }
-  int forwardSize = utils::internal::simpleAtoi(dimensions[0]);
-  int backwardSize = utils::internal::simpleAtoi(dimensions[1]);
-  if (forwardSize <= 0 || backwardSize <= 0) {
-    ifs.close();
+  const char* begin = file.getData();
+  const char* end = begin + file.getSize();
+  const char* bodyBegin = std::find(begin, end, '\n');
+
+  int forwardSize, backwardSize;
+  const char* current = begin;
+  if (!internal::consumeInt(current, bodyBegin, forwardSize) ||
+      !internal::consumeInt(current, bodyBegin, backwardSize) ||
+      forwardSize <= 0 || backwardSize <= 0) {
     return absl::InvalidArgumentError("Malformed matrix.def");
   }
+  if (bodyBegin != end) bodyBegin++;
 
   LOG(INFO) << "Forward Size: " << forwardSize
             << ", Backward Size: " << backwardSize;
 
-  std::vector<int> array(forwardSize * backwardSize);
-
-  while (std::getline(ifs, line)) {
-    std::vector<std::string> splits = absl::StrSplit(line, " ");
-
-    if (splits.size() != 3) {
-      ifs.close();
-      return absl::InvalidArgumentError("Malformed matrix.def");
-    }
+  // fill costs in place to avoid an additional copy of the whole matrix
+  auto* costLists = connectionCost->mutable_cost_lists();
+  costLists->Resize(forwardSize * backwardSize, 0);
+  int* costs = costLists->mutable_data();
+
+  // Split the body into byte ranges aligned to lines, and parse each range
+  // concurrently. Each range has at least 1MiB.
+  const int numRanges = std::min(internal::resolveNumThreads(numThreads),
+                                 static_cast<int>((end - bodyBegin) >> 20) + 1);
+  std::vector<const char*> bounds(numRanges + 1, end);
+  bounds[0] = bodyBegin;
+  for (int i = 1; i < numRanges; i++) {
+    const char* bound = std::max(
+        bounds[i - 1], bodyBegin + (end - bodyBegin) / numRanges * i);
+    bound = std::find(bound, end, '\n');
+    bounds[i] = bound == end ? end : bound + 1;
+  }
 
-    int forwardId = utils::internal::simpleAtoi(splits[0]);
-    int backwardId = utils::internal::simpleAtoi(splits[1]);
-    int cost = utils::internal::simpleAtoi(splits[2]);
-    array[backwardSize * forwardId + backwardId] = cost;
+  std::vector<absl::Status> statuses(numRanges);
+  std::vector<std::thread> workers;
+  for (int i = 1; i < numRanges; i++) {
+    workers.emplace_back([&, i]() {
+      statuses[i] = internal::parseMatrixDefLines(
+          bounds[i], bounds[i + 1], forwardSize, backwardSize, costs);
+    });
+  }
+  statuses[0] = internal::parseMatrixDefLines(bounds[0], bounds[1],
+                                              forwardSize, backwardSize, costs);
+  for (auto& thread : workers) thread.join();
+  for (const auto& status : statuses) {
+    if (!status.ok()) return status;
   }
-  noriDictionary.mutable_connection_cost()->mutable_cost_lists()->Assign(
-      array.begin(), array.end());
-  noriDictionary.mutable_connection_cost()->set_forward_size(forwardSize);
-  noriDictionary.mutable_connection_cost()->set_backward_size(backwardSize);
 
-  ifs.close();
+  connectionCost->set_forward_size(forwardSize);
+  connectionCost->set_backward_size(backwardSize);
+
+  LOG(INFO) << "Built connection costs in " << internal::elapsedMs(start)
+            << "ms";
   return absl::OkStatus();
 }
 
-absl::Status DictionaryBuilder::findLeftRightIds(absl::string_view input) {
+absl::Status DictionaryBuilder::findLeftRightIds(
+    absl::string_view input, nori::protos::Dictionary* ids) const {
   // find requried left id
   {
     const auto path = utils::internal::joinPath(input, "left-id.def");
@@ -374,8 +1274,8 @@ absl::Status DictionaryBuilder::findLeftRightIds(absl::string_view input) {
     while (std::getline(ifs, line)) {
       // NNG LeftId
       if (absl::StrContains(line, "NNG,*,*,*,*,*,*,*")) {
-        std::vector<std::string> splits = absl::StrSplit(line, " ");
-        noriDictionary.set_left_id_nng(utils::internal::simpleAtoi(splits[0]));
+        std::vector<absl::string_view> splits = absl::StrSplit(line, " ");
+        ids->set_left_id_nng(utils::internal::simpleAtoi(splits[0]));
       }
     }
   }
@@ -392,30 +1292,28 @@ absl::Status DictionaryBuilder::findLeftRightIds(absl::string_view input) {
     while (std::getline(ifs, line)) {
       // NNG rightId
       if (absl::StrContains(line, "NNG,*,*,*,*,*,*,*")) {
-        std::vector<std::string> splits = absl::StrSplit(line, " ");
-        noriDictionary.set_right_id_nng(utils::internal::simpleAtoi(splits[0]));
+        std::vector<absl::string_view> splits = absl::StrSplit(line, " ");
+        ids->set_right_id_nng(utils::internal::simpleAtoi(splits[0]));
       }
 
       // NNG rightId with jongsung
       else if (absl::StrContains(line, "NNG,*,T,*,*,*,*,*")) {
-        std::vector<std::string> splits = absl::StrSplit(line, " ");
-        noriDictionary.set_right_id_nng_t(
-            utils::internal::simpleAtoi(splits[0]));
+        std::vector<absl::string_view> splits = absl::StrSplit(line, " ");
+        ids->set_right_id_nng_t(utils::internal::simpleAtoi(splits[0]));
       }
 
       // NNG rightId without jongsung
       else if (absl::StrContains(line, "NNG,*,F,*,*,*,*,*")) {
-        std::vector<std::string> splits = absl::StrSplit(line, " ");
-        noriDictionary.set_right_id_nng_f(
-            utils::internal::simpleAtoi(splits[0]));
+        std::vector<absl::string_view> splits = absl::StrSplit(line, " ");
+        ids->set_right_id_nng_f(utils::internal::simpleAtoi(splits[0]));
       }
     }
   }
 
-  LOG(INFO) << "left-id for NNG: " << noriDictionary.left_id_nng()
-            << ", right-id for NNG: " << noriDictionary.right_id_nng()
-            << ", right-id with Jongsung: " << noriDictionary.right_id_nng_t()
-            << ", right-id w/o Jongsung: " << noriDictionary.right_id_nng_f();
+  LOG(INFO) << "left-id for NNG: " << ids->left_id_nng()
+            << ", right-id for NNG: " << ids->right_id_nng()
+            << ", right-id with Jongsung: " << ids->right_id_nng_t()
+            << ", right-id w/o Jongsung: " << ids->right_id_nng_f();
 
   return absl::OkStatus();
 }
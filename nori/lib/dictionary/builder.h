@@ -33,30 +33,114 @@ namespace internal {
 //  * 9   - left POS
 //  * 10  - right POS
 //  * 11  - expression
+absl::Status convertMeCabCSVEntry(const std::vector<absl::string_view>& entry,
+                                  nori::protos::Morpheme* morpheme);
 absl::Status convertMeCabCSVEntry(const std::vector<std::string>& entry,
                                   nori::protos::Morpheme* morpheme);
 
+// Rows of a MeCab's csv file. Each row points to `content`, so this struct
+// should not be moved after parsing.
+struct CSVFile {
+  std::string content;
+  std::vector<std::vector<absl::string_view>> rows;
+};
+
+// Read, normalize (if `normalize` is true) and parse the csv file.
+absl::Status readMeCabCSVFile(const std::string& path, bool normalize,
+                              const std::string& normalizationForm,
+                              CSVFile& output);
+
+// Parse lines of matrix.def ("forwardId backwardId cost") in [begin, end) and
+// put costs into `costs`. This function doesn't allocate memory, so it can be
+// called for each byte range of the file concurrently.
+absl::Status parseMatrixDefLines(const char* begin, const char* end,
+                                 int forwardSize, int backwardSize,
+                                 int* costs);
+
+// Binary connection cost file
+//
+// The file starts with the magic "NORICOST", and forward size, backward size
+// and all costs follow as int32 values in host byte order.
+absl::Status saveBinaryConnectionCost(
+    const std::string& path,
+    const nori::protos::ConnectionCost& connectionCost);
+absl::Status loadBinaryConnectionCost(
+    const std::string& path, nori::protos::ConnectionCost* connectionCost);
+
+// Hash contents of `paths` and `salt` into a hex string. It is used as a key
+// of the build cache, so it is stable across processes.
+absl::Status hashFiles(const std::vector<std::string>& paths,
+                       absl::string_view salt, std::string& key);
+
 }  // namespace internal
 
 class DictionaryBuilder {
  public:
-  DictionaryBuilder(bool normalize, const std::string normalizationForm)
-      : normalize(normalize), normalizationForm(normalizationForm) {}
+  // If numThreads is 0, the builder uses all available cores. `keyEncoding` is
+  // the encoding of trie keys. HANGUL_COMPACT makes the trie smaller and
+  // shallower for Korean text. If `withAhoCorasick` is true, the Aho-Corasick
+  // automaton of the keys is built together, and the tokenizer matches all
+  // terms of a sentence in a single pass with it.
+  DictionaryBuilder(
+      bool normalize, const std::string normalizationForm, int numThreads = 0,
+      nori::protos::KeyEncoding keyEncoding = nori::protos::KeyEncoding::UTF8,
+      bool withAhoCorasick = false)
+      : normalize(normalize),
+        normalizationForm(normalizationForm),
+        numThreads(numThreads),
+        keyEncoding(keyEncoding),
+        withAhoCorasick(withAhoCorasick) {}
 
   ~DictionaryBuilder() = default;
-  absl::Status build(absl::string_view inputDirectory);
+
+  // If `cacheDirectory` is not empty, parsed csv files, unknown tokens and
+  // connection costs are cached in it keyed by the hash of their sources, and
+  // only changed sources are parsed again in the next build.
+  absl::Status build(absl::string_view inputDirectory,
+                     absl::string_view cacheDirectory = "");
   absl::Status save(std::string outputFilename);
 
+  // Build and save the dictionary without keeping all csv rows in memory.
+  //
+  // Rows are sorted with an external merge sort using temporary files in
+  // `temporaryDirectory`, and morphemes are streamed into the output file.
+  // Rows held in memory at once are bounded by `memoryBudget` bytes, and runs
+  // are merged in passes of at most K runs with K derived from the budget, so
+  // read buffers and open files are bounded too. Trie keys, the trie itself,
+  // the Aho-Corasick automaton and the connection costs are not bounded,
+  // because they have to be complete in memory.
+  absl::Status buildStreaming(absl::string_view inputDirectory,
+                              std::string outputFilename, size_t memoryBudget,
+                              absl::string_view temporaryDirectory);
+
+  // load prebuilt dictionary to modify it.
+  absl::Status loadPrebuilt(std::string filename);
+
+  // replace connection costs with the binary connection cost file.
+  absl::Status importConnectionCost(std::string filename);
+
+  // save connection costs as the binary connection cost file.
+  absl::Status exportConnectionCost(std::string filename) const;
+
  private:
-  absl::Status buildTokenInfos(absl::string_view inputDirectory);
-  absl::Status buildUnknownTokenInfos(absl::string_view inputDirectory);
-  absl::Status buildConnectionCost(absl::string_view inputDirectory);
-  absl::Status findLeftRightIds(absl::string_view inputDirectory);
+  absl::Status buildTokenInfos(absl::string_view inputDirectory,
+                               absl::string_view cacheDirectory);
+  absl::Status buildUnknownTokenInfos(
+      absl::string_view inputDirectory,
+      nori::protos::UnknownTokens* unknownTokens) const;
+  absl::Status buildConnectionCost(
+      absl::string_view inputDirectory,
+      nori::protos::ConnectionCost* connectionCost) const;
+  absl::Status findLeftRightIds(absl::string_view inputDirectory,
+                                nori::protos::Dictionary* ids) const;
 
   nori::protos::Dictionary noriDictionary;
 
   bool normalize;
   const std::string normalizationForm;
+  const int numThreads;
+  const nori::protos::KeyEncoding keyEncoding;
+  const bool withAhoCorasick;
 };
 
 }  // namespace builder
@@ -32,6 +32,80 @@ TEST(TestInternal, convertMeCabCSVEntry) {
   ASSERT_EQ(morpheme2.expression_size(), 0);
 }
 
+TEST(TestInternal, readMeCabCSVFile) {
+  internal::CSVFile file;
+  auto status = internal::readMeCabCSVFile(
+      "./testdata/dictionaryBuilder/test.csv", false, "NFKC", file);
+  ASSERT_TRUE(status.ok()) << status.message();
+
+  ASSERT_EQ(file.rows.size(), 21);
+  ASSERT_EQ(file.rows[0][0], "ㄴ강");
+  ASSERT_EQ(file.rows[0][4], "EC");
+}
+
+TEST(TestInternal, parseMatrixDefLines) {
+  std::string lines = "0 1 -3\n\n1 0 7\r\n1 1\t5";
+  std::vector<int> costs(4, 0);
+  auto status = internal::parseMatrixDefLines(
+      lines.data(), lines.data() + lines.size(), 2, 2, costs.data());
+  ASSERT_TRUE(status.ok()) << status.message();
+  ASSERT_THAT(costs, testing::ElementsAre(0, -3, 7, 5));
+
+  lines = "0 2 1\n";
+  status = internal::parseMatrixDefLines(
+      lines.data(), lines.data() + lines.size(), 2, 2, costs.data());
+  ASSERT_FALSE(status.ok());
+
+  lines = "0 1 a\n";
+  status = internal::parseMatrixDefLines(
+      lines.data(), lines.data() + lines.size(), 2, 2, costs.data());
+  ASSERT_FALSE(status.ok());
+}
+
+TEST(TestInternal, binaryConnectionCost) {
+  nori::protos::ConnectionCost connectionCost;
+  connectionCost.set_forward_size(2);
+  connectionCost.set_backward_size(3);
+  for (int i = 0; i < 6; i++) connectionCost.add_cost_lists(i - 3);
+
+  auto status =
+      internal::saveBinaryConnectionCost("connection_cost.bin", connectionCost);
+  ASSERT_TRUE(status.ok()) << status.message();
+
+  nori::protos::ConnectionCost loaded;
+  status = internal::loadBinaryConnectionCost("connection_cost.bin", &loaded);
+  ASSERT_TRUE(status.ok()) << status.message();
+  ASSERT_EQ(loaded.forward_size(), 2);
+  ASSERT_EQ(loaded.backward_size(), 3);
+  ASSERT_THAT(loaded.cost_lists(), testing::ElementsAre(-3, -2, -1, 0, 1, 2));
+
+  status = internal::loadBinaryConnectionCost(
+      "./testdata/dictionaryBuilder/matrix.def", &loaded);
+  ASSERT_FALSE(status.ok());
+}
+
+TEST(TestInternal, hashFiles) {
+  std::string key1, key2;
+  auto status = internal::hashFiles(
+      {"./testdata/dictionaryBuilder/matrix.def"}, "", key1);
+  ASSERT_TRUE(status.ok()) << status.message();
+  ASSERT_EQ(key1.size(), 16);
+
+  status = internal::hashFiles({"./testdata/dictionaryBuilder/matrix.def"},
+                               "NFKC", key2);
+  ASSERT_TRUE(status.ok()) << status.message();
+  ASSERT_NE(key1, key2);
+
+  status = internal::hashFiles({"./testdata/dictionaryBuilder/matrix.def"},
+                               "", key2);
+  ASSERT_TRUE(status.ok()) << status.message();
+  ASSERT_EQ(key1, key2);
+
+  status = internal::hashFiles({"./testdata/dictionaryBuilder/missing.def"},
+                               "", key2);
+  ASSERT_FALSE(status.ok());
+}
+
 TEST(TestBuilder, DictionaryBuilder) {
   DictionaryBuilder builder(true, "NFKC");
   auto status = builder.build("./testdata/dictionaryBuilder/");
@@ -39,4 +113,29 @@ TEST(TestBuilder, DictionaryBuilder) {
 
   status = builder.save("dictionary.nori");
   ASSERT_TRUE(status.ok()) << status.message();
+
+  DictionaryBuilder singleThreadBuilder(true, "NFKC", 1);
+  status = singleThreadBuilder.build("./testdata/dictionaryBuilder/");
+  ASSERT_TRUE(status.ok()) << status.message();
+
+  status = builder.exportConnectionCost("connection_cost.bin");
+  ASSERT_TRUE(status.ok()) << status.message();
+
+  DictionaryBuilder loadedBuilder(false, "");
+  status = loadedBuilder.loadPrebuilt("dictionary.nori");
+  ASSERT_TRUE(status.ok()) << status.message();
+  status = loadedBuilder.importConnectionCost("connection_cost.bin");
+  ASSERT_TRUE(status.ok()) << status.message();
+
+  // the matrix must have the size of the dictionary.
+  nori::protos::ConnectionCost connectionCost;
+  connectionCost.set_forward_size(1);
+  connectionCost.set_backward_size(1);
+  connectionCost.add_cost_lists(0);
+  status = internal::saveBinaryConnectionCost("connection_cost_1x1.bin",
+                                              connectionCost);
+  ASSERT_TRUE(status.ok()) << status.message();
+  status = loadedBuilder.importConnectionCost("connection_cost_1x1.bin");
+  ASSERT_FALSE(status.ok());
+  ASSERT_TRUE(absl::IsInvalidArgument(status));
 }
@@ -2,7 +2,10 @@
 
 #include <darts.h>
 
+#include <algorithm>
+#include <cstring>
 #include <fstream>
+#include <numeric>
 #include <sstream>
 
 #include "absl/log/log.h"
@@ -21,9 +24,8 @@ namespace dictionary {
 
 namespace internal {
 
-// read, uncompress, and parse protobuf message
-template <class T>
-absl::Status deserializeProtobuf(const std::string& path, T& message) {
+absl::Status deserializeProtobuf(const std::string& path,
+                                 nori::protos::Dictionary& message) {
   std::ifstream ifs(path, std::ios::in | std::ios::binary);
   if (ifs.fail())
     return absl::InvalidArgumentError(absl::StrCat("Cannot open file ", path));
@@ -46,6 +48,241 @@ absl::Status deserializeProtobuf(const std::string& path, T& message) {
   return absl::OkStatus();
 }
 
+// split a line of the user dictionary into a term and its sub terms. An empty
+// vector is returned for empty lines and comments.
+std::vector<std::string> splitUserDictionaryLine(std::string rawLine,
+                                                 const RE2& spacePattern) {
+  RE2::Replace(&rawLine, spacePattern, " ");
+  absl::string_view line(rawLine);
+
+  {
+    // remove trailing comments
+    auto it = std::find_if(line.begin(), line.end(),
+                           [](char x) { return x == '#'; });
+    line = line.substr(0, it - line.begin());
+  }
+  line = absl::StripAsciiWhitespace(line);
+  if (line == "") {
+    // skip empty line
+    return {};
+  }
+
+  return absl::StrSplit(line, " ");
+}
+
+void buildUserMorpheme(const std::vector<std::string>& term, int leftId,
+                       int rightId, int rightId_T, int rightId_F,
+                       nori::protos::Morpheme* morpheme) {
+  morpheme->set_left_id(leftId);
+  auto lastCharType = utils::internal::detectLastCharacterType(term[0]);
+  if (lastCharType == utils::internal::LastCharType::NNG_T) {
+    morpheme->set_right_id(rightId_T);
+  } else if (lastCharType == utils::internal::LastCharType::NNG_F) {
+    morpheme->set_right_id(rightId_F);
+  } else {
+    morpheme->set_right_id(rightId);
+  }
+  morpheme->set_word_cost(-100000);
+  morpheme->set_pos_type(term.size() == 1 ? nori::protos::POSType::MORPHEME
+                                          : nori::protos::POSType::COMPOUND);
+
+  morpheme->add_pos_tags(nori::protos::POSTag::NNG);
+  for (int i = 2; i < term.size(); i++)
+    morpheme->add_pos_tags(nori::protos::POSTag::NNG);
+  for (int i = 1; i < term.size() - 1; i++) {
+    auto expr = morpheme->add_expression();
+    expr->set_pos_tag(nori::protos::POSTag::NNG);
+    expr->set_surface(term[i]);
+  }
+}
+
+uint32_t FirstCodePointBitmap::getIndex(const char* begin, const char* end) {
+  UChar32 c;
+  int i = 0;
+  U8_NEXT(begin, i, end - begin, c);
+  // use the first byte for malformed sequences
+  if (c < 0) c = static_cast<unsigned char>(*begin);
+  return static_cast<uint32_t>(c) & 0xFFFF;
+}
+
+// index of the character in the compact alphabet of HANGUL_COMPACT, or -1
+inline int getCompactIndex(UChar32 c) {
+  constexpr int kNumSyllables = 0xD7A3 - 0xAC00 + 1;
+  constexpr int kNumJamo = 0x11FF - 0x1100 + 1;
+  if (c >= 0xAC00 && c <= 0xD7A3) return c - 0xAC00;
+  if (c >= 0x1100 && c <= 0x11FF) return kNumSyllables + c - 0x1100;
+  if (c >= 0x3131 && c <= 0x318E) return kNumSyllables + kNumJamo + c - 0x3131;
+  return -1;
+}
+
+// encode the character at `offset` into `output` with HANGUL_COMPACT. It
+// advances `offset` and returns the number of bytes in `output` (at most 4).
+inline int encodeCompactCharacter(const char* begin, int& offset, int length,
+                                  char* output) {
+  const int start = offset;
+  UChar32 c;
+  U8_NEXT(begin, offset, length, c);
+
+  if (c < 0) {
+    offset = start + 1;
+    output[0] = static_cast<char>(0xFF);
+    output[1] = begin[start];
+    return 2;
+  }
+
+  const int index = getCompactIndex(c);
+  if (index >= 0) {
+    output[0] = static_cast<char>(0x80 + index / 255);
+    output[1] = static_cast<char>(1 + index % 255);
+    return 2;
+  }
+
+  std::memcpy(output, begin + start, offset - start);
+  return offset - start;
+}
+
+void encodeTrieKey(absl::string_view key, nori::protos::KeyEncoding encoding,
+                   std::string& output) {
+  if (encoding == nori::protos::KeyEncoding::UTF8) {
+    output.assign(key.data(), key.size());
+    return;
+  }
+
+  output.clear();
+  char buffer[4];
+  int offset = 0;
+  while (offset < key.size()) {
+    const int size =
+        encodeCompactCharacter(key.data(), offset, key.size(), buffer);
+    output.append(buffer, size);
+  }
+}
+
+absl::Status buildTrie(const std::vector<absl::string_view>& keys,
+                       nori::protos::KeyEncoding encoding,
+                       Darts::DoubleArray& trie) {
+  if (keys.empty()) return absl::InvalidArgumentError("No keys to build trie");
+
+  // darts requires keys in byte order, and the order of encoded keys can
+  // differ from the order of keys.
+  std::vector<std::string> encodedKeys;
+  std::vector<int> values(keys.size());
+  std::iota(values.begin(), values.end(), 0);
+  if (encoding != nori::protos::KeyEncoding::UTF8) {
+    encodedKeys.resize(keys.size());
+    for (int i = 0; i < keys.size(); i++)
+      encodeTrieKey(keys[i], encoding, encodedKeys[i]);
+    std::stable_sort(values.begin(), values.end(), [&](int a, int b) {
+      return encodedKeys[a] < encodedKeys[b];
+    });
+  }
+
+  std::vector<const char*> sortedKeys(keys.size());
+  std::vector<size_t> sortedKeyLengths(keys.size());
+  for (int i = 0; i < keys.size(); i++) {
+    const auto key = encodedKeys.empty()
+                         ? keys[values[i]]
+                         : absl::string_view(encodedKeys[values[i]]);
+    sortedKeys[i] = key.data();
+    sortedKeyLengths[i] = key.size();
+  }
+
+  if (trie.build(sortedKeys.size(), const_cast<char**>(&sortedKeys[0]),
+                 &sortedKeyLengths[0], &values[0]) != 0)
+    return absl::InternalError("Cannot build trie.");
+
+  // darts keeps the first value of duplicated keys.
+  for (int i = 0; i < keys.size(); i++) {
+    const int value = exactMatchSearch(trie, encoding, keys[i]);
+    if (value < 0 || keys[value] != keys[i])
+      return absl::InternalError("Trie isn't built properly.");
+  }
+  return absl::OkStatus();
+}
+
+size_t compactCommonPrefixSearch(const Darts::DoubleArray& trie,
+                                 const char* begin, const char* end,
+                                 Darts::DoubleArray::result_pair_type* results,
+                                 size_t maxResults, size_t* numReadBytes) {
+  // traverse the trie character by character, so the input is not encoded
+  // ahead.
+  const int length = end - begin;
+  size_t numResults = 0;
+  size_t nodePos = 0;
+  char buffer[4];
+  int offset = 0;
+  while (offset < length) {
+    const int size = encodeCompactCharacter(begin, offset, length, buffer);
+    size_t keyPos = 0;
+    const int value = trie.traverse(buffer, nodePos, keyPos, size);
+    if (value == -2) break;
+    if (value >= 0) {
+      if (numResults < maxResults) {
+        results[numResults].value = value;
+        results[numResults].length = offset;
+      }
+      numResults++;
+    }
+  }
+  if (numReadBytes != nullptr) *numReadBytes = offset;
+  return numResults;
+}
+
+size_t commonPrefixSearch(const Darts::DoubleArray& trie,
+                          nori::protos::KeyEncoding encoding,
+                          const char* begin, const char* end,
+                          Darts::DoubleArray::result_pair_type* results,
+                          size_t maxResults, size_t& numReadBytes) {
+  if (encoding != nori::protos::KeyEncoding::UTF8)
+    return compactCommonPrefixSearch(trie, begin, end, results, maxResults,
+                                     &numReadBytes);
+
+  // traverse the trie byte by byte to find where the search stops. traverse
+  // keeps keyPos at the byte that has no transition.
+  const size_t length = end - begin;
+  size_t numResults = 0;
+  size_t nodePos = 0, keyPos = 0;
+  numReadBytes = length;
+  while (keyPos < length) {
+    const int value = trie.traverse(begin, nodePos, keyPos, keyPos + 1);
+    if (value == -2) {
+      numReadBytes = keyPos + 1;
+      break;
+    }
+    if (value >= 0) {
+      if (numResults < maxResults) {
+        results[numResults].value = value;
+        results[numResults].length = keyPos;
+      }
+      numResults++;
+    }
+  }
+  return numResults;
+}
+
+int exactMatchSearch(const Darts::DoubleArray& trie,
+                     nori::protos::KeyEncoding encoding,
+                     absl::string_view key) {
+  int result;
+  if (encoding == nori::protos::KeyEncoding::UTF8) {
+    trie.exactMatchSearch(key.data(), result, key.size());
+    return result;
+  }
+
+  std::string encoded;
+  encodeTrieKey(key, encoding, encoded);
+  trie.exactMatchSearch(encoded.data(), result, encoded.size());
+  return result;
+}
+
+bool isCompiledUserDictionary(const std::string& filename) {
+  std::ifstream ifs(filename, std::ios::in | std::ios::binary);
+  char magic[sizeof(UserDictionaryHeader::magic)];
+  ifs.read(magic, sizeof(magic));
+  return !ifs.fail() && std::memcmp(magic, kUserDictionaryMagic,
+                                    sizeof(magic)) == 0;
+}
+
 }  // namespace internal
 
 // Dictionary
@@ -62,6 +299,26 @@ absl::Status Dictionary::loadPrebuilt(std::string input) {
   trie.set_array(dictionary.darts_array().data(),
                  dictionary.darts_array().size());
 
+  // first code points of the trie keys
+  const auto& firstCodePointsData = dictionary.first_code_points();
+  hasFirstCodePoints =
+      firstCodePointsData.size() ==
+      internal::FirstCodePointBitmap::kNumWords * sizeof(uint64_t);
+  if (hasFirstCodePoints) {
+    std::memcpy(firstCodePoints.getMutableWords()->data(),
+                firstCodePointsData.data(), firstCodePointsData.size());
+  } else if (!firstCodePointsData.empty()) {
+    LOG(WARNING) << "Ignore malformed first code points of " << input;
+  }
+  dictionary.clear_first_code_points();
+
+  if (dictionary.has_aho_corasick()) {
+    status = ahoCorasick.load(dictionary.aho_corasick());
+    if (!status.ok()) return status;
+  } else {
+    ahoCorasick = AhoCorasick();
+  }
+
   // backwardSize
   backwardSize = dictionary.connection_cost().backward_size();
   forwardSize = dictionary.connection_cost().forward_size();
@@ -78,16 +335,72 @@ absl::Status Dictionary::loadPrebuilt(std::string input) {
 }
 
 absl::Status Dictionary::loadUser(std::string filename) {
-  auto status = userDictionary.load(
+  std::shared_ptr<const UserDictionary> nextUserDictionary;
+  auto status = loadUserOverlay(filename, nextUserDictionary);
+  if (!status.ok()) return status;
+
+  std::atomic_store(&userDictionary, std::move(nextUserDictionary));
+  return absl::OkStatus();
+}
+
+absl::Status Dictionary::loadUserOverlay(
+    std::string filename,
+    std::shared_ptr<const UserDictionary>& userDictionary) const {
+  const auto load = internal::isCompiledUserDictionary(filename)
+                        ? &UserDictionary::loadCompiled
+                        : &UserDictionary::load;
+  auto loaded = std::make_shared<UserDictionary>();
+  auto status = ((*loaded).*load)(
       filename, dictionary.left_id_nng(), dictionary.right_id_nng(),
-      dictionary.right_id_nng_t(), dictionary.right_id_nng_f());
+      dictionary.right_id_nng_t(), dictionary.right_id_nng_f(),
+      dictionary.key_encoding());
   if (absl::IsCancelled(status)) {
+    // empty user dictionary
     LOG(WARNING) << status.message();
+    userDictionary.reset();
     return absl::OkStatus();
   }
+  if (!status.ok()) return status;
 
-  if (status.ok()) userInitialized = true;
-  return status;
+  userDictionary = std::move(loaded);
+  return absl::OkStatus();
+}
+
+absl::Status Dictionary::addUserTerm(absl::string_view line) {
+  auto current = acquireUserDict();
+  while (true) {
+    std::shared_ptr<const UserDictionary> next;
+    auto status =
+        current != nullptr
+            ? current->addTerm(line, next)
+            : UserDictionary(dictionary.left_id_nng(),
+                             dictionary.right_id_nng(),
+                             dictionary.right_id_nng_t(),
+                             dictionary.right_id_nng_f(),
+                             dictionary.key_encoding())
+                  .addTerm(line, next);
+    if (!status.ok()) return status;
+
+    // retry if other thread updated the user dictionary.
+    if (std::atomic_compare_exchange_strong(&userDictionary, &current, next))
+      return absl::OkStatus();
+  }
+}
+
+absl::Status Dictionary::removeUserTerm(absl::string_view surface) {
+  auto current = acquireUserDict();
+  while (true) {
+    if (current == nullptr)
+      return absl::NotFoundError(absl::StrCat("Cannot find term ", surface));
+
+    std::shared_ptr<const UserDictionary> next;
+    auto status = current->removeTerm(surface, next);
+    if (!status.ok()) return status;
+
+    // retry if other thread updated the user dictionary.
+    if (std::atomic_compare_exchange_strong(&userDictionary, &current, next))
+      return absl::OkStatus();
+  }
 }
 
 const nori::protos::CharacterClass Dictionary::getCharClass(
@@ -106,10 +419,22 @@ const nori::protos::CharacterClass Dictionary::getCharClass(
 
 // User Dictionary
 
+UserDictionary::UserDictionary(int leftId, int rightId, int rightId_T,
+                               int rightId_F,
+                               nori::protos::KeyEncoding keyEncoding)
+    : loadedTerms(std::make_shared<LoadedTerms>()),
+      leftId(leftId),
+      rightId(rightId),
+      rightId_T(rightId_T),
+      rightId_F(rightId_F),
+      keyEncoding(keyEncoding) {}
+
 absl::Status UserDictionary::load(std::string filename, int leftId, int rightId,
-                                  int rightId_T, int rightId_F) {
-  trie.clear();
-  morphemes.clear();
+                                  int rightId_T, int rightId_F,
+                                  nori::protos::KeyEncoding keyEncoding) {
+  *this = UserDictionary(leftId, rightId, rightId_T, rightId_F, keyEncoding);
+  auto& trie = loadedTerms->trie;
+  auto& morphemes = loadedTerms->morphemes;
 
   std::ifstream ifs(filename);
   if (ifs.fail())
@@ -123,23 +448,8 @@ absl::Status UserDictionary::load(std::string filename, int leftId, int rightId,
 
   std::vector<std::vector<std::string>> terms;
   while (std::getline(ifs, rawLine)) {
-    RE2::Replace(&rawLine, spacePattern, " ");
-    absl::string_view line(rawLine);
-
-    {
-      // remove trailing comments
-      auto it = std::find_if(line.begin(), line.end(),
-                             [](char x) { return x == '#'; });
-      line = line.substr(0, it - line.begin());
-    }
-    line = absl::StripAsciiWhitespace(line);
-    if (line == "") {
-      // skip empty line
-      continue;
-    }
-
-    std::vector<std::string> splits = absl::StrSplit(line, " ");
-    terms.push_back(splits);
+    auto term = internal::splitUserDictionaryLine(rawLine, spacePattern);
+    if (!term.empty()) terms.push_back(std::move(term));
   }
   ifs.close();
 
@@ -148,54 +458,340 @@ absl::Status UserDictionary::load(std::string filename, int leftId, int rightId,
     return absl::CancelledError("# terms in User Dictionary == 0");
   }
 
-  std::stable_sort(
-      terms.begin(), terms.end(),
-      [](const std::vector<std::string> a, const std::vector<std::string> b) {
-        return a[0] < b[0];
-      });
+  std::stable_sort(terms.begin(), terms.end(),
+                   [](const std::vector<std::string>& a,
+                      const std::vector<std::string>& b) {
+                     return a[0] < b[0];
+                   });
+
+  std::vector<absl::string_view> keys;
+  morphemes.resize(terms.size());
+  for (int i = 0; i < terms.size(); i++) {
+    keys.push_back(terms[i][0]);
+    loadedTerms->firstCodePoints.add(terms[i][0]);
+    internal::buildUserMorpheme(terms[i], leftId, rightId, rightId_T,
+                                rightId_F, &morphemes[i]);
+  }
+
+  return internal::buildTrie(keys, keyEncoding, trie);
+}
 
-  std::vector<const char*> keys;
-  for (const auto& term : terms) {
-    keys.push_back(term[0].data());
+absl::Status UserDictionary::loadCompiled(
+    std::string filename, int leftId, int rightId, int rightId_T,
+    int rightId_F, nori::protos::KeyEncoding keyEncoding) {
+  *this = UserDictionary(leftId, rightId, rightId_T, rightId_F, keyEncoding);
+  auto& trie = loadedTerms->trie;
+  auto& morphemes = loadedTerms->morphemes;
 
-    nori::protos::Morpheme morpheme;
+  auto status = loadedTerms->mappedFile.open(filename);
+  if (!status.ok()) return status;
 
-    morpheme.set_left_id(leftId);
-    auto lastCharType = utils::internal::detectLastCharacterType(term[0]);
-    if (lastCharType == utils::internal::LastCharType::NNG_T) {
-      morpheme.set_right_id(rightId_T);
-    } else if (lastCharType == utils::internal::LastCharType::NNG_F) {
-      morpheme.set_right_id(rightId_F);
-    } else {
-      morpheme.set_right_id(rightId);
+  const char* data = loadedTerms->mappedFile.getData();
+  const size_t size = loadedTerms->mappedFile.getSize();
+
+  internal::UserDictionaryHeader header;
+  if (size < sizeof(header))
+    return absl::InvalidArgumentError(
+        absl::StrCat("Malformed user dictionary ", filename));
+  std::memcpy(&header, data, sizeof(header));
+
+  if (std::memcmp(header.magic, internal::kUserDictionaryMagic,
+                  sizeof(header.magic)) != 0 ||
+      header.version != internal::kUserDictionaryVersion)
+    return absl::InvalidArgumentError(
+        absl::StrCat("Unsupported user dictionary ", filename));
+
+  if (header.leftId != leftId || header.rightId != rightId ||
+      header.rightIdT != rightId_T || header.rightIdF != rightId_F ||
+      header.keyEncoding != keyEncoding)
+    return absl::InvalidArgumentError(absl::StrCat(
+        filename, " is compiled with another system dictionary"));
+
+  const size_t bitmapOffset = sizeof(header);
+  const size_t dartsOffset =
+      bitmapOffset +
+      sizeof(uint64_t) * internal::FirstCodePointBitmap::kNumWords;
+  const size_t morphemesOffset = dartsOffset + header.dartsSize;
+  const size_t expressionsOffset =
+      morphemesOffset +
+      sizeof(internal::UserMorphemeRecord) * header.numMorphemes;
+  const size_t posTagsOffset =
+      expressionsOffset +
+      sizeof(internal::UserExpressionRecord) * header.numExpressions;
+  const size_t stringPoolOffset =
+      posTagsOffset + sizeof(int32_t) * header.numPosTags;
+  if (size != stringPoolOffset + header.stringPoolSize ||
+      header.dartsSize % trie.unit_size() != 0 || header.numMorphemes == 0)
+    return absl::InvalidArgumentError(
+        absl::StrCat("Malformed user dictionary ", filename));
+
+  const auto* records = reinterpret_cast<const internal::UserMorphemeRecord*>(
+      data + morphemesOffset);
+  const auto* expressions =
+      reinterpret_cast<const internal::UserExpressionRecord*>(
+          data + expressionsOffset);
+  const auto* posTags = reinterpret_cast<const int32_t*>(data + posTagsOffset);
+  const char* stringPool = data + stringPoolOffset;
+
+  // morphemes are materialized, because the tokenizer refers protobuf
+  // messages. The trie is used in place.
+  morphemes.resize(header.numMorphemes);
+  for (uint32_t i = 0; i < header.numMorphemes; i++) {
+    const auto& record = records[i];
+    if (record.posTagsBegin > header.numPosTags ||
+        record.numPosTags > header.numPosTags - record.posTagsBegin ||
+        record.expressionsBegin > header.numExpressions ||
+        record.numExpressions >
+            header.numExpressions - record.expressionsBegin)
+      return absl::InvalidArgumentError(
+          absl::StrCat("Malformed user dictionary ", filename));
+
+    auto& morpheme = morphemes[i];
+    morpheme.set_left_id(record.leftId);
+    morpheme.set_right_id(record.rightId);
+    morpheme.set_word_cost(record.wordCost);
+    morpheme.set_pos_type(
+        static_cast<nori::protos::POSType>(record.posType));
+
+    morpheme.mutable_pos_tags()->Reserve(record.numPosTags);
+    for (uint32_t j = 0; j < record.numPosTags; j++) {
+      morpheme.add_pos_tags(static_cast<nori::protos::POSTag>(
+          posTags[record.posTagsBegin + j]));
     }
-    morpheme.set_word_cost(-100000);
-    morpheme.set_pos_type(term.size() == 1 ? nori::protos::POSType::MORPHEME
-                                           : nori::protos::POSType::COMPOUND);
-
-    morpheme.add_pos_tags(nori::protos::POSTag::NNG);
-    for (int i = 2; i < term.size(); i++)
-      morpheme.add_pos_tags(nori::protos::POSTag::NNG);
-    for (int i = 1; i < term.size() - 1; i++) {
+
+    for (uint32_t j = 0; j < record.numExpressions; j++) {
+      const auto& expression = expressions[record.expressionsBegin + j];
+      if (expression.surfaceBegin > header.stringPoolSize ||
+          expression.surfaceLength >
+              header.stringPoolSize - expression.surfaceBegin)
+        return absl::InvalidArgumentError(
+            absl::StrCat("Malformed user dictionary ", filename));
+
       auto expr = morpheme.add_expression();
-      expr->set_pos_tag(nori::protos::POSTag::NNG);
-      expr->set_surface(term[i]);
+      expr->set_pos_tag(static_cast<nori::protos::POSTag>(expression.posTag));
+      expr->set_surface(stringPool + expression.surfaceBegin,
+                        expression.surfaceLength);
     }
+  }
 
-    morphemes.push_back(morpheme);
+  std::memcpy(loadedTerms->firstCodePoints.getMutableWords()->data(),
+              data + bitmapOffset,
+              sizeof(uint64_t) * internal::FirstCodePointBitmap::kNumWords);
+  trie.set_array(data + dartsOffset, header.dartsSize / trie.unit_size());
+  return absl::OkStatus();
+}
+
+absl::Status UserDictionary::saveCompiled(std::string filename) const {
+  const auto& trie = loadedTerms->trie;
+  const auto& morphemes = loadedTerms->morphemes;
+  if (morphemes.empty())
+    return absl::FailedPreconditionError("User dictionary is not loaded");
+  if (addedTerms != nullptr)
+    return absl::FailedPreconditionError(
+        "Terms added or removed after loading cannot be compiled");
+
+  std::vector<internal::UserMorphemeRecord> records;
+  std::vector<internal::UserExpressionRecord> expressions;
+  std::vector<int32_t> posTags;
+  std::string stringPool;
+  records.reserve(morphemes.size());
+  for (const auto& morpheme : morphemes) {
+    internal::UserMorphemeRecord record;
+    record.leftId = morpheme.left_id();
+    record.rightId = morpheme.right_id();
+    record.wordCost = morpheme.word_cost();
+    record.posType = morpheme.pos_type();
+    record.posTagsBegin = posTags.size();
+    record.numPosTags = morpheme.pos_tags_size();
+    record.expressionsBegin = expressions.size();
+    record.numExpressions = morpheme.expression_size();
+    records.push_back(record);
+
+    posTags.insert(posTags.end(), morpheme.pos_tags().begin(),
+                   morpheme.pos_tags().end());
+    for (const auto& expr : morpheme.expression()) {
+      expressions.push_back({expr.pos_tag(),
+                             static_cast<uint32_t>(stringPool.size()),
+                             static_cast<uint32_t>(expr.surface().size())});
+      stringPool.append(expr.surface());
+    }
   }
 
-  if (trie.build(keys.size(), const_cast<char**>(&keys[0])) != 0)
-    return absl::InternalError("Cannot build trie.");
+  internal::UserDictionaryHeader header;
+  std::memcpy(header.magic, internal::kUserDictionaryMagic,
+              sizeof(header.magic));
+  header.version = internal::kUserDictionaryVersion;
+  header.leftId = leftId;
+  header.rightId = rightId;
+  header.rightIdT = rightId_T;
+  header.rightIdF = rightId_F;
+  header.keyEncoding = keyEncoding;
+  header.dartsSize = trie.total_size();
+  header.numMorphemes = records.size();
+  header.numExpressions = expressions.size();
+  header.numPosTags = posTags.size();
+  header.stringPoolSize = stringPool.size();
+
+  std::ofstream ofs(filename, std::ios::out | std::ios::binary);
+  if (ofs.fail())
+    return absl::InvalidArgumentError(
+        absl::StrCat("Cannot open file ", filename));
+
+  ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  const auto& bitmap = loadedTerms->firstCodePoints.getWords();
+  ofs.write(reinterpret_cast<const char*>(bitmap.data()),
+            sizeof(uint64_t) * bitmap.size());
+  ofs.write(static_cast<const char*>(trie.array()), trie.total_size());
+  ofs.write(reinterpret_cast<const char*>(records.data()),
+            sizeof(internal::UserMorphemeRecord) * records.size());
+  ofs.write(reinterpret_cast<const char*>(expressions.data()),
+            sizeof(internal::UserExpressionRecord) * expressions.size());
+  ofs.write(reinterpret_cast<const char*>(posTags.data()),
+            sizeof(int32_t) * posTags.size());
+  ofs.write(stringPool.data(), stringPool.size());
+  ofs.close();
+
+  if (ofs.fail())
+    return absl::InternalError(absl::StrCat("Cannot write file ", filename));
+  return absl::OkStatus();
+}
+
+// Persistent trie of terms that are added or removed after loading.
+struct UserDictionary::TermNode {
+  // sorted by labels
+  std::vector<std::pair<char, std::shared_ptr<const TermNode>>> children;
+  // true if a term ends at this node. It shadows the loaded term of the same
+  // surface.
+  bool hasTerm = false;
+  // morpheme of the term. nullptr if the term is removed.
+  std::shared_ptr<const nori::protos::Morpheme> morpheme;
+
+  const TermNode* findChild(char label) const {
+    auto it = std::lower_bound(
+        children.begin(), children.end(), label,
+        [](const std::pair<char, std::shared_ptr<const TermNode>>& child,
+           char label) { return child.first < label; });
+    if (it == children.end() || it->first != label) return nullptr;
+    return it->second.get();
+  }
+};
+
+// copy nodes on the path of `key` and set the term of the last node.
+std::shared_ptr<const UserDictionary::TermNode> UserDictionary::setTerm(
+    const TermNode* node, absl::string_view key,
+    std::shared_ptr<const nori::protos::Morpheme> morpheme) {
+  auto copied = node == nullptr ? std::make_shared<TermNode>()
+                                : std::make_shared<TermNode>(*node);
+  if (key.empty()) {
+    copied->hasTerm = true;
+    copied->morpheme = std::move(morpheme);
+    return copied;
+  }
+
+  auto& children = copied->children;
+  auto it = std::lower_bound(
+      children.begin(), children.end(), key[0],
+      [](const std::pair<char, std::shared_ptr<const TermNode>>& child,
+         char label) { return child.first < label; });
+  if (it == children.end() || it->first != key[0])
+    it = children.emplace(it, key[0], nullptr);
+  it->second = setTerm(it->second.get(), key.substr(1), std::move(morpheme));
+  return copied;
+}
+
+const UserDictionary::TermNode* UserDictionary::findAddedTerm(
+    const char* begin, size_t length) const {
+  const TermNode* node = addedTerms.get();
+  for (size_t i = 0; i < length && node != nullptr; i++)
+    node = node->findChild(begin[i]);
+  return node != nullptr && node->hasTerm ? node : nullptr;
+}
+
+absl::Status UserDictionary::addTerm(
+    absl::string_view line,
+    std::shared_ptr<const UserDictionary>& output) const {
+  RE2 spacePattern(R"(\s+)");
+  if (!spacePattern.ok()) {
+    return absl::InternalError("Cannot build re2 pattern");
+  }
+
+  auto term =
+      internal::splitUserDictionaryLine(std::string(line), spacePattern);
+  if (term.empty())
+    return absl::InvalidArgumentError(absl::StrCat("Empty term: ", line));
 
-  // search second item to check Trie is built properly
-  int searchResult;
-  trie.exactMatchSearch(keys[1], searchResult);
-  if (searchResult != 1)
-    return absl::InternalError("Trie isn't built properly.");
+  auto morpheme = std::make_shared<nori::protos::Morpheme>();
+  internal::buildUserMorpheme(term, leftId, rightId, rightId_T, rightId_F,
+                              morpheme.get());
 
+  auto next = std::make_shared<UserDictionary>(*this);
+  next->addedTerms = setTerm(addedTerms.get(), term[0], std::move(morpheme));
+  output = std::move(next);
   return absl::OkStatus();
 }
 
+absl::Status UserDictionary::removeTerm(
+    absl::string_view surface,
+    std::shared_ptr<const UserDictionary>& output) const {
+  const auto* node = findAddedTerm(surface.data(), surface.size());
+  bool found = node != nullptr && node->morpheme != nullptr;
+  if (node == nullptr && !surface.empty() &&
+      !loadedTerms->morphemes.empty()) {
+    found = internal::exactMatchSearch(loadedTerms->trie, keyEncoding,
+                                       surface) != -1;
+  }
+  if (!found)
+    return absl::NotFoundError(absl::StrCat("Cannot find term ", surface));
+
+  auto next = std::make_shared<UserDictionary>(*this);
+  next->addedTerms = setTerm(addedTerms.get(), surface, nullptr);
+  output = std::move(next);
+  return absl::OkStatus();
+}
+
+const nori::protos::Morpheme* UserDictionary::findLongestTerm(
+    const char* begin, const char* end,
+    Darts::DoubleArray::result_pair_type* results, size_t maxResults,
+    size_t& length) const {
+  const nori::protos::Morpheme* morpheme = nullptr;
+  length = 0;
+
+  // terms added after loading
+  const TermNode* node = addedTerms.get();
+  for (const char* current = begin; node != nullptr; current++) {
+    if (node->hasTerm && node->morpheme != nullptr) {
+      morpheme = node->morpheme.get();
+      length = current - begin;
+    }
+    if (current == end) break;
+    node = node->findChild(*current);
+  }
+
+  if (loadedTerms->morphemes.empty() ||
+      !loadedTerms->firstCodePoints.mayContain(begin, end))
+    return morpheme;
+
+  // loaded terms that are longer and not shadowed. Results of the trie are
+  // sorted by length.
+  const int numResults =
+      std::min<int>(internal::commonPrefixSearch(loadedTerms->trie,
+                                                 keyEncoding, begin, end,
+                                                 results, maxResults),
+                    maxResults);
+  for (int i = numResults - 1; i >= 0 && results[i].length > length; i--) {
+    // values of a corrupt compiled trie can be out of range.
+    if (results[i].value < 0 ||
+        results[i].value >= static_cast<int>(loadedTerms->morphemes.size()))
+      continue;
+    if (addedTerms != nullptr &&
+        findAddedTerm(begin, results[i].length) != nullptr)
+      continue;
+
+    length = results[i].length;
+    return &loadedTerms->morphemes[results[i].value];
+  }
+  return morpheme;
+}
+
 }  // namespace dictionary
 }  // namespace nori
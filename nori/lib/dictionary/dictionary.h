@@ -3,8 +3,13 @@
 
 #include <darts.h>
 
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "absl/status/status.h"
 #include "absl/strings/string_view.h"
+#include "nori/lib/dictionary/aho_corasick.h"
 #include "nori/lib/protos/dictionary.pb.h"
 #include "nori/lib/utils.h"
 
@@ -17,26 +22,224 @@
 namespace nori {
 namespace dictionary {
 
+namespace internal {
+
+// read, uncompress, and parse dictionary protobuf message
+absl::Status deserializeProtobuf(const std::string& path,
+                                 nori::protos::Dictionary& message);
+
+// Presence bitmap of the first code points of terms. It is used to skip trie
+// searches at positions where no term can start. Code points are folded into
+// 16 bits, so supplementary characters can share bits with BMP characters.
+class FirstCodePointBitmap {
+ public:
+  static constexpr size_t kNumWords = (1 << 16) / 64;
+
+  FirstCodePointBitmap() : words(kNumWords, 0) {}
+
+  // add the first code point of the term.
+  void add(absl::string_view term) {
+    if (term.empty()) return;
+    const uint32_t index = getIndex(term.data(), term.data() + term.size());
+    words[index >> 6] |= uint64_t(1) << (index & 63);
+  }
+
+  // return false if no term starts with the code point at `begin`.
+  bool mayContain(const char* begin, const char* end) const {
+    const uint32_t index = getIndex(begin, end);
+    return (words[index >> 6] >> (index & 63)) & 1;
+  }
+
+  const std::vector<uint64_t>& getWords() const { return words; }
+  std::vector<uint64_t>* getMutableWords() { return &words; }
+
+ private:
+  static uint32_t getIndex(const char* begin, const char* end);
+
+  std::vector<uint64_t> words;
+};
+
+// Trie keys
+//
+// With KeyEncoding::HANGUL_COMPACT, Hangul syllables, Hangul Jamo and Hangul
+// compatibility Jamo are encoded into a lead byte in [0x80, 0xAD] and a trail
+// byte, instead of three UTF-8 bytes. Other characters are UTF-8 bytes, and
+// each byte of malformed sequences is escaped with 0xFF. Lead bytes of the
+// classes don't overlap, so the encoding is prefix-free and keeps boundaries
+// of characters.
+
+// encode `key` to a key of the trie.
+void encodeTrieKey(absl::string_view key, nori::protos::KeyEncoding encoding,
+                   std::string& output);
+
+// build the trie of `keys`. The value of each key is its index. Keys must be
+// sorted in byte order, but encoded keys can be in any order.
+absl::Status buildTrie(const std::vector<absl::string_view>& keys,
+                       nori::protos::KeyEncoding encoding,
+                       Darts::DoubleArray& trie);
+
+size_t compactCommonPrefixSearch(
+    const Darts::DoubleArray& trie, const char* begin, const char* end,
+    Darts::DoubleArray::result_pair_type* results, size_t maxResults,
+    size_t* numReadBytes = nullptr);
+
+// search keys of the trie that are prefixes of [begin, end). Lengths of the
+// results are in bytes of the input, and it returns the number of all found
+// keys like Darts::DoubleArray::commonPrefixSearch.
+inline size_t commonPrefixSearch(const Darts::DoubleArray& trie,
+                                 nori::protos::KeyEncoding encoding,
+                                 const char* begin, const char* end,
+                                 Darts::DoubleArray::result_pair_type* results,
+                                 size_t maxResults) {
+  if (encoding == nori::protos::KeyEncoding::UTF8)
+    return trie.commonPrefixSearch(begin, results, maxResults, end - begin);
+  return compactCommonPrefixSearch(trie, begin, end, results, maxResults);
+}
+
+// commonPrefixSearch that also sets `numReadBytes` to the number of bytes of
+// the input that the search reads. The results only depend on these bytes.
+size_t commonPrefixSearch(const Darts::DoubleArray& trie,
+                          nori::protos::KeyEncoding encoding,
+                          const char* begin, const char* end,
+                          Darts::DoubleArray::result_pair_type* results,
+                          size_t maxResults, size_t& numReadBytes);
+
+// return the value of `key`, or -1 if the trie doesn't have it.
+int exactMatchSearch(const Darts::DoubleArray& trie,
+                     nori::protos::KeyEncoding encoding, absl::string_view key);
+
+// Compiled user dictionary
+//
+// The file starts with UserDictionaryHeader. The first code point bitmap, the
+// darts array, morpheme records, expression records, pos tags and the string
+// pool follow in order. All values are in host byte order, and all sections
+// are 4-byte aligned.
+constexpr char kUserDictionaryMagic[] = "NORIUSER";
+constexpr int32_t kUserDictionaryVersion = 3;
+
+struct UserDictionaryHeader {
+  char magic[8];
+  int32_t version;
+  // ids of the system dictionary that the user dictionary is compiled with.
+  int32_t leftId;
+  int32_t rightId;
+  int32_t rightIdT;
+  int32_t rightIdF;
+  // nori::protos::KeyEncoding of the trie
+  int32_t keyEncoding;
+  // size of darts array in bytes.
+  uint32_t dartsSize;
+  uint32_t numMorphemes;
+  uint32_t numExpressions;
+  uint32_t numPosTags;
+  uint32_t stringPoolSize;
+};
+
+struct UserMorphemeRecord {
+  int32_t leftId;
+  int32_t rightId;
+  int32_t wordCost;
+  int32_t posType;
+  // range of pos tags
+  uint32_t posTagsBegin;
+  uint32_t numPosTags;
+  // range of expression records
+  uint32_t expressionsBegin;
+  uint32_t numExpressions;
+};
+
+struct UserExpressionRecord {
+  int32_t posTag;
+  // range of the string pool
+  uint32_t surfaceBegin;
+  uint32_t surfaceLength;
+};
+
+// return true if the file is a compiled user dictionary.
+bool isCompiledUserDictionary(const std::string& filename);
+
+}  // namespace internal
+
 // User dictionary interface.
 // you don't need to access this class directly, because
 // nori::dictionary::Dictionary class has userDictionary field.
 class UserDictionary {
  public:
-  // load dictionary from given path
-  absl::Status load(std::string filename, int leftId, int rightId,
-                    int rightId_T, int rightId_F);
+  UserDictionary() : UserDictionary(0, 0, 0, 0) {}
+  UserDictionary(
+      int leftId, int rightId, int rightId_T, int rightId_F,
+      nori::protos::KeyEncoding keyEncoding = nori::protos::KeyEncoding::UTF8);
 
-  // return trie dictionary.
-  const Darts::DoubleArray* getTrie() const { return &trie; }
-
-  // get all morphemes for the trie.
+  // load dictionary from given path
+  absl::Status load(
+      std::string filename, int leftId, int rightId, int rightId_T,
+      int rightId_F,
+      nori::protos::KeyEncoding keyEncoding = nori::protos::KeyEncoding::UTF8);
+
+  // map compiled dictionary from given path. The trie is used in place, and
+  // ids and the key encoding must be equal to the ones that the dictionary is
+  // compiled with.
+  absl::Status loadCompiled(
+      std::string filename, int leftId, int rightId, int rightId_T,
+      int rightId_F,
+      nori::protos::KeyEncoding keyEncoding = nori::protos::KeyEncoding::UTF8);
+
+  // compile loaded dictionary to given path.
+  absl::Status saveCompiled(std::string filename) const;
+
+  // Return a new user dictionary with an added term, or without a term.
+  //
+  // `line` has the same format as a line of the user dictionary file. Loaded
+  // terms are shared, and added or removed terms are kept in a persistent
+  // trie, so an update only copies the trie nodes on the path of the term.
+  // Updated terms are dropped by the next load.
+  absl::Status addTerm(absl::string_view line,
+                       std::shared_ptr<const UserDictionary>& output) const;
+  absl::Status removeTerm(absl::string_view surface,
+                          std::shared_ptr<const UserDictionary>& output) const;
+
+  // Find the longest term that starts at `begin`. `results` is a buffer for
+  // the trie search with `maxResults` elements. It returns nullptr if there is
+  // no term.
+  const nori::protos::Morpheme* findLongestTerm(
+      const char* begin, const char* end,
+      Darts::DoubleArray::result_pair_type* results, size_t maxResults,
+      size_t& length) const;
+
+  // return trie dictionary of loaded terms. Its keys are encoded with
+  // getKeyEncoding().
+  const Darts::DoubleArray* getTrie() const { return &loadedTerms->trie; }
+
+  nori::protos::KeyEncoding getKeyEncoding() const { return keyEncoding; }
+
+  // get all loaded morphemes for the trie.
   const std::vector<nori::protos::Morpheme>* getMorphemes() const {
-    return &morphemes;
+    return &loadedTerms->morphemes;
   }
 
  private:
-  Darts::DoubleArray trie;
-  std::vector<nori::protos::Morpheme> morphemes;
+  struct LoadedTerms {
+    Darts::DoubleArray trie;
+    std::vector<nori::protos::Morpheme> morphemes;
+    internal::FirstCodePointBitmap firstCodePoints;
+    // backing storage of the trie for compiled dictionaries
+    utils::internal::MappedFile mappedFile;
+  };
+  struct TermNode;
+
+  static std::shared_ptr<const TermNode> setTerm(
+      const TermNode* node, absl::string_view key,
+      std::shared_ptr<const nori::protos::Morpheme> morpheme);
+  const TermNode* findAddedTerm(const char* begin, size_t length) const;
+
+  // shared by all versions of the user dictionary
+  std::shared_ptr<LoadedTerms> loadedTerms;
+  // terms that are added or removed after loading
+  std::shared_ptr<const TermNode> addedTerms;
+
+  // ids used to build morphemes
+  int leftId, rightId, rightId_T, rightId_F;
+  nori::protos::KeyEncoding keyEncoding;
 };
 
 class Normalizer {
@@ -48,11 +251,13 @@ class Normalizer {
     this->normalizationForm = normalizationForm;
   }
 
-  absl::Status normalize(const std::string in, std::string& out) const {
+  // normalize `in` into `out`. The buffer of `out` is reused.
+  absl::Status normalize(absl::string_view in, std::string& out) const {
+    out.clear();
     if (doNormalize)
       return utils::internal::normalizeUTF8(in, out, normalizationForm);
 
-    out.assign(in);
+    out.assign(in.data(), in.size());
     return absl::OkStatus();
   }
 
@@ -66,20 +271,84 @@ class Dictionary {
   // load prebuilt dictionary from given path
   absl::Status loadPrebuilt(std::string path);
 
-  // load user dictionary from given path
+  // load user dictionary from given path. The file can be a text file or a
+  // compiled user dictionary (see build_user_dictionary).
+  //
+  // It is safe to call this method while other threads are tokenizing. The new
+  // user dictionary is built aside and published atomically. Running
+  // tokenizations keep the previous one until they finish. If loading fails,
+  // the previous one is kept.
   absl::Status loadUser(std::string filename);
 
+  // load user dictionary from given path without publishing it. The output can
+  // be passed to NoriTokenizer::tokenize as an overlay, and it is nullptr if
+  // the user dictionary is empty.
+  absl::Status loadUserOverlay(
+      std::string filename,
+      std::shared_ptr<const UserDictionary>& userDictionary) const;
+
+  // add or remove a term of the user dictionary without rebuilding its trie.
+  // `line` has the same format as a line of the user dictionary file. Like
+  // loadUser, it is safe to call these methods while other threads are
+  // tokenizing. Updated terms are kept until the next loadUser.
+  absl::Status addUserTerm(absl::string_view line);
+  absl::Status removeUserTerm(absl::string_view surface);
+
   // return is initialized
   bool isInitialized() const { return initialized; }
 
   // return is initialized
-  bool isUserInitialized() const { return userInitialized; }
+  bool isUserInitialized() const { return acquireUserDict() != nullptr; }
 
-  // return trie dictionary
+  // return trie dictionary. Its keys are encoded with getKeyEncoding().
   const Darts::DoubleArray* getTrie() const { return &trie; }
 
-  // return user dictionary
-  const UserDictionary* getUserDict() const { return &userDictionary; }
+  nori::protos::KeyEncoding getKeyEncoding() const {
+    return dictionary.key_encoding();
+  }
+
+  // return the Aho-Corasick automaton of the trie keys. It is nullptr if the
+  // dictionary is built without it.
+  const AhoCorasick* getAhoCorasick() const {
+    return ahoCorasick.isLoaded() ? &ahoCorasick : nullptr;
+  }
+
+  // search terms of the trie that are prefixes of [begin, end). See
+  // internal::commonPrefixSearch.
+  size_t commonPrefixSearch(const char* begin, const char* end,
+                            Darts::DoubleArray::result_pair_type* results,
+                            size_t maxResults) const {
+    return internal::commonPrefixSearch(trie, dictionary.key_encoding(), begin,
+                                        end, results, maxResults);
+  }
+
+  // commonPrefixSearch that also returns the number of bytes from `begin` that
+  // the results depend on.
+  size_t commonPrefixSearch(const char* begin, const char* end,
+                            Darts::DoubleArray::result_pair_type* results,
+                            size_t maxResults, size_t& numReadBytes) const {
+    return internal::commonPrefixSearch(trie, dictionary.key_encoding(), begin,
+                                        end, results, maxResults,
+                                        numReadBytes);
+  }
+
+  // return false if no term of the trie starts with the character at `begin`.
+  // It always returns true for dictionaries without the first code points.
+  bool mayStartTerm(const char* begin, const char* end) const {
+    return !hasFirstCodePoints || firstCodePoints.mayContain(begin, end);
+  }
+
+  // return user dictionary. It can be nullptr.
+  //
+  // The returned pointer is invalidated by the next loadUser, addUserTerm or
+  // removeUserTerm call, which publish a new user dictionary. Prefer
+  // acquireUserDict, which keeps the user dictionary alive.
+  const UserDictionary* getUserDict() const { return acquireUserDict().get(); }
+
+  // return the current user dictionary. It can be nullptr.
+  std::shared_ptr<const UserDictionary> acquireUserDict() const {
+    return std::atomic_load(&userDictionary);
+  }
 
   // return token dictionary
   const nori::protos::Tokens* getTokens() const { return &dictionary.tokens(); }
@@ -120,12 +389,16 @@ class Dictionary {
 
  private:
   bool initialized = false;
-  bool userInitialized = false;
 
   Darts::DoubleArray trie;
+  internal::FirstCodePointBitmap firstCodePoints;
+  bool hasFirstCodePoints = false;
+  // refers arrays of `dictionary`
+  AhoCorasick ahoCorasick;
   nori::protos::Dictionary dictionary;
   Normalizer normalizer;
-  UserDictionary userDictionary;
+  // published with std::atomic_store, and read with std::atomic_load
+  std::shared_ptr<const UserDictionary> userDictionary;
 
   // for tokenizer
   nori::protos::Morpheme bosEosMorpheme;
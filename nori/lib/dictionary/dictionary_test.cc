@@ -3,8 +3,21 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <sys/stat.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <set>
+
+#include "absl/strings/match.h"
+#include "absl/strings/str_join.h"
+#include "absl/strings/str_split.h"
 #include "nori/lib/dictionary/builder.h"
 #include "nori/lib/protos/dictionary.pb.h"
+#include "nori/lib/utils.h"
 
 using namespace nori::dictionary;
 using namespace nori::dictionary::builder;
@@ -20,6 +33,308 @@ TEST(TestBuilder, load) {
   Dictionary dic;
   status = dic.loadPrebuilt("dictionary.nori");
   ASSERT_TRUE(status.ok()) << status.message();
+
+  // all terms start with "ㄴ"
+  std::string key;
+  status = dic.getNormalizer()->normalize("ㄴ다", key);
+  ASSERT_TRUE(status.ok()) << status.message();
+  ASSERT_TRUE(dic.mayStartTerm(key.data(), key.data() + key.size()));
+  std::string other = "다";
+  ASSERT_FALSE(dic.mayStartTerm(other.data(), other.data() + other.size()));
+}
+
+namespace {
+
+// Assert that `actual` is the same dictionary as `expected`. `csvPath` gives
+// the trie keys to look up.
+void expectSameDictionary(const Dictionary& expected, const Dictionary& actual,
+                          const std::string& csvPath) {
+  ASSERT_EQ(actual.getTokens()->morphemes_list_size(),
+            expected.getTokens()->morphemes_list_size());
+  for (int i = 0; i < expected.getTokens()->morphemes_list_size(); i++) {
+    ASSERT_EQ(actual.getTokens()->morphemes_list(i).SerializeAsString(),
+              expected.getTokens()->morphemes_list(i).SerializeAsString())
+        << "morphemes list " << i;
+  }
+
+  std::ifstream ifs(csvPath);
+  ASSERT_FALSE(ifs.fail()) << csvPath;
+  std::string line;
+  std::vector<std::string> entry;
+  int numKeys = 0;
+  while (std::getline(ifs, line)) {
+    entry.clear();
+    nori::utils::internal::parseCSVLine(line, entry);
+    std::string key;
+    auto status = expected.getNormalizer()->normalize(entry[0], key);
+    ASSERT_TRUE(status.ok()) << status.message();
+
+    const int expectedResult = nori::dictionary::internal::exactMatchSearch(
+        *expected.getTrie(), expected.getKeyEncoding(), key);
+    ASSERT_NE(expectedResult, -1) << key;
+    ASSERT_EQ(nori::dictionary::internal::exactMatchSearch(
+                  *actual.getTrie(), actual.getKeyEncoding(), key),
+              expectedResult)
+        << key;
+    numKeys++;
+  }
+  ASSERT_GT(numKeys, 0);
+
+  ASSERT_EQ(actual.getConnectionCosts()->SerializeAsString(),
+            expected.getConnectionCosts()->SerializeAsString());
+}
+
+}  // namespace
+
+TEST(TestBuilder, loadStreaming) {
+  DictionaryBuilder builder(true, "NFKC");
+  auto status = builder.build("./testdata/dictionaryBuilder/");
+  ASSERT_TRUE(status.ok()) << status.message();
+  status = builder.save("dictionary.nori");
+  ASSERT_TRUE(status.ok()) << status.message();
+
+  Dictionary expected;
+  status = expected.loadPrebuilt("dictionary.nori");
+  ASSERT_TRUE(status.ok()) << status.message();
+
+  // A budget of 1 byte writes a sorted run for each row and merges them in
+  // several passes of 2 runs. A large budget merges them at once.
+  for (const size_t memoryBudget : {size_t{1}, size_t{64} << 20}) {
+    DictionaryBuilder streamingBuilder(true, "NFKC");
+    status = streamingBuilder.buildStreaming("./testdata/dictionaryBuilder/",
+                                             "streaming-dictionary.nori",
+                                             memoryBudget, ".");
+    ASSERT_TRUE(status.ok()) << status.message();
+
+    Dictionary dic;
+    status = dic.loadPrebuilt("streaming-dictionary.nori");
+    ASSERT_TRUE(status.ok()) << status.message();
+
+    expectSameDictionary(expected, dic,
+                         "./testdata/dictionaryBuilder/test.csv");
+    if (HasFatalFailure()) return;
+
+    std::string key;
+    status = dic.getNormalizer()->normalize("ㄴ다든가", key);
+    ASSERT_TRUE(status.ok()) << status.message();
+    ASSERT_TRUE(dic.mayStartTerm(key.data(), key.data() + key.size()));
+    std::string other = "다";
+    ASSERT_FALSE(dic.mayStartTerm(other.data(), other.data() + other.size()));
+  }
+}
+
+namespace {
+
+// Copy testdata into `directory`, splitting test.csv into a.csv and b.csv.
+// If `modify` is true, the word cost of the first row of b.csv is changed.
+void copyTestdata(const std::string& directory, bool modify) {
+  mkdir(directory.c_str(), 0755);
+  for (const std::string filename :
+       {"char.def", "unk.def", "matrix.def", "left-id.def", "right-id.def"}) {
+    std::ifstream ifs("./testdata/dictionaryBuilder/" + filename);
+    std::ofstream ofs(directory + filename);
+    ASSERT_TRUE(ifs.is_open() && ofs.is_open()) << filename;
+    ofs << ifs.rdbuf();
+  }
+
+  std::ifstream ifs("./testdata/dictionaryBuilder/test.csv");
+  std::ofstream a(directory + "a.csv"), b(directory + "b.csv");
+  ASSERT_TRUE(ifs.is_open() && a.is_open() && b.is_open());
+  int numRows = 0;
+  for (std::string line; std::getline(ifs, line); numRows++) {
+    if (numRows < 10) {
+      a << line << "\n";
+      continue;
+    }
+    if (modify && numRows == 10) {
+      std::vector<std::string> fields = absl::StrSplit(line, ',');
+      fields[3] = "1234";
+      line = absl::StrJoin(fields, ",");
+    }
+    b << line << "\n";
+  }
+}
+
+std::set<std::string> listCacheFiles(const std::string& directory) {
+  std::vector<std::string> paths;
+  nori::utils::internal::listDirectory(
+      directory, paths,
+      [](absl::string_view path) { return absl::EndsWith(path, ".cache"); });
+  return std::set<std::string>(paths.begin(), paths.end());
+}
+
+}  // namespace
+
+TEST(TestBuilder, loadCached) {
+  const std::string directory = "./cached-testdata/";
+  const std::string cacheDirectory = "./cached-testdata-cache/";
+  copyTestdata(directory, false);
+  if (HasFatalFailure()) return;
+  mkdir(cacheDirectory.c_str(), 0755);
+  for (const auto& path : listCacheFiles(cacheDirectory))
+    std::remove(path.c_str());
+
+  // a cache entry for each csv file, unknown tokens and connection costs
+  DictionaryBuilder builder(true, "NFKC");
+  auto status = builder.build(directory, cacheDirectory);
+  ASSERT_TRUE(status.ok()) << status.message();
+  const auto cacheFiles = listCacheFiles(cacheDirectory);
+  std::map<std::string, int> numCacheFiles;
+  for (const auto& path : cacheFiles) {
+    const auto filename = path.substr(path.rfind('/') + 1);
+    numCacheFiles[filename.substr(0, filename.find('-'))]++;
+  }
+  ASSERT_THAT(numCacheFiles,
+              ::testing::ElementsAre(::testing::Pair("csv", 2),
+                                     ::testing::Pair("matrix", 1),
+                                     ::testing::Pair("unk", 1)));
+
+  // only the changed csv file is parsed again
+  copyTestdata(directory, true);
+  if (HasFatalFailure()) return;
+  DictionaryBuilder cachedBuilder(true, "NFKC");
+  status = cachedBuilder.build(directory, cacheDirectory);
+  ASSERT_TRUE(status.ok()) << status.message();
+  status = cachedBuilder.save("cached-dictionary.nori");
+  ASSERT_TRUE(status.ok()) << status.message();
+
+  std::vector<std::string> newCacheFiles;
+  for (const auto& path : listCacheFiles(cacheDirectory)) {
+    if (cacheFiles.count(path) == 0) newCacheFiles.push_back(path);
+  }
+  ASSERT_EQ(newCacheFiles.size(), 1);
+  ASSERT_TRUE(absl::StrContains(newCacheFiles[0], "/csv-"))
+      << newCacheFiles[0];
+
+  DictionaryBuilder uncachedBuilder(true, "NFKC");
+  status = uncachedBuilder.build(directory);
+  ASSERT_TRUE(status.ok()) << status.message();
+  status = uncachedBuilder.save("uncached-dictionary.nori");
+  ASSERT_TRUE(status.ok()) << status.message();
+
+  Dictionary expected, dic;
+  status = expected.loadPrebuilt("uncached-dictionary.nori");
+  ASSERT_TRUE(status.ok()) << status.message();
+  status = dic.loadPrebuilt("cached-dictionary.nori");
+  ASSERT_TRUE(status.ok()) << status.message();
+  for (const std::string csv : {"a.csv", "b.csv"}) {
+    expectSameDictionary(expected, dic, directory + csv);
+    if (HasFatalFailure()) return;
+  }
+  ASSERT_EQ(dic.getUnkTokens()->morpheme_map_size(), 14);
+}
+
+TEST(TestBuilder, loadCompactKeys) {
+  DictionaryBuilder builder(true, "NFKC", 0,
+                            nori::protos::KeyEncoding::HANGUL_COMPACT);
+  auto status = builder.build("./testdata/dictionaryBuilder/");
+  ASSERT_TRUE(status.ok()) << status.message();
+  status = builder.save("compact-dictionary.nori");
+  ASSERT_TRUE(status.ok()) << status.message();
+
+  Dictionary dic;
+  status = dic.loadPrebuilt("compact-dictionary.nori");
+  ASSERT_TRUE(status.ok()) << status.message();
+  ASSERT_EQ(dic.getKeyEncoding(), nori::protos::KeyEncoding::HANGUL_COMPACT);
+
+  std::string key;
+  status = dic.getNormalizer()->normalize("ㄴ다든가", key);
+  ASSERT_TRUE(status.ok()) << status.message();
+  ASSERT_NE(nori::dictionary::internal::exactMatchSearch(
+                *dic.getTrie(), dic.getKeyEncoding(), key),
+            -1);
+
+  // lengths of results are in bytes of the input
+  const std::string input = key + "요";
+  std::vector<Darts::DoubleArray::result_pair_type> results(16);
+  const size_t numResults =
+      dic.commonPrefixSearch(input.data(), input.data() + input.size(),
+                             results.data(), results.size());
+  ASSERT_GT(numResults, 0);
+  ASSERT_EQ(results[numResults - 1].length, key.size());
+}
+
+TEST(TestInternal, compactTrieKeys) {
+  using nori::protos::KeyEncoding;
+  namespace internal = nori::dictionary::internal;
+
+  std::string encoded;
+  internal::encodeTrieKey("세종", KeyEncoding::HANGUL_COMPACT, encoded);
+  ASSERT_EQ(encoded.size(), 4);
+  internal::encodeTrieKey("c++", KeyEncoding::HANGUL_COMPACT, encoded);
+  ASSERT_EQ(encoded, "c++");
+  internal::encodeTrieKey("漢字", KeyEncoding::HANGUL_COMPACT, encoded);
+  ASSERT_EQ(encoded, "漢字");
+
+  // keys are sorted in byte order, and "\xff" is a malformed sequence.
+  const std::vector<absl::string_view> keys = {
+      "c", "c++", "c샤프", "ᄂ다", "漢字", "세", "세종", "세종시", "\xff"};
+  Darts::DoubleArray utf8Trie, compactTrie;
+  auto status = internal::buildTrie(keys, KeyEncoding::UTF8, utf8Trie);
+  ASSERT_TRUE(status.ok()) << status.message();
+  status = internal::buildTrie(keys, KeyEncoding::HANGUL_COMPACT, compactTrie);
+  ASSERT_TRUE(status.ok()) << status.message();
+
+  for (const std::string input :
+       {"세종시청", "c샤프", "c++", "ᄂ다가", "漢字", "\xff\xff", "가"}) {
+    std::vector<Darts::DoubleArray::result_pair_type> utf8Results(16),
+        compactResults(16);
+    const size_t numUtf8Results = internal::commonPrefixSearch(
+        utf8Trie, KeyEncoding::UTF8, input.data(), input.data() + input.size(),
+        utf8Results.data(), utf8Results.size());
+    const size_t numCompactResults = internal::commonPrefixSearch(
+        compactTrie, KeyEncoding::HANGUL_COMPACT, input.data(),
+        input.data() + input.size(), compactResults.data(),
+        compactResults.size());
+    ASSERT_EQ(numUtf8Results, numCompactResults) << input;
+    for (int i = 0; i < numUtf8Results; i++) {
+      ASSERT_EQ(utf8Results[i].value, compactResults[i].value) << input;
+      ASSERT_EQ(utf8Results[i].length, compactResults[i].length) << input;
+    }
+
+    // results only depend on the bytes that the search reads.
+    for (const auto encoding :
+         {KeyEncoding::UTF8, KeyEncoding::HANGUL_COMPACT}) {
+      const auto& trie = encoding == KeyEncoding::UTF8 ? utf8Trie : compactTrie;
+      std::vector<Darts::DoubleArray::result_pair_type> results(16);
+      size_t numReadBytes;
+      ASSERT_EQ(internal::commonPrefixSearch(
+                    trie, encoding, input.data(), input.data() + input.size(),
+                    results.data(), results.size(), numReadBytes),
+                numUtf8Results)
+          << input;
+      ASSERT_LE(numReadBytes, input.size()) << input;
+      for (int i = 0; i < numUtf8Results; i++) {
+        ASSERT_EQ(results[i].value, utf8Results[i].value) << input;
+        ASSERT_LE(results[i].length, numReadBytes) << input;
+      }
+    }
+  }
+
+  size_t numReadBytes;
+  Darts::DoubleArray::result_pair_type result;
+  const std::string sejong = "세종시청";
+  internal::commonPrefixSearch(utf8Trie, KeyEncoding::UTF8, sejong.data(),
+                               sejong.data() + sejong.size(), &result, 1,
+                               numReadBytes);
+  ASSERT_EQ(numReadBytes, 10);
+  internal::commonPrefixSearch(compactTrie, KeyEncoding::HANGUL_COMPACT,
+                               sejong.data(), sejong.data() + sejong.size(),
+                               &result, 1, numReadBytes);
+  ASSERT_EQ(numReadBytes, 12);
+}
+
+TEST(TestInternal, FirstCodePointBitmap) {
+  nori::dictionary::internal::FirstCodePointBitmap bitmap;
+  bitmap.add("세종");
+  bitmap.add("c++");
+
+  const std::string matched = "세기", ascii = "c샤프", unmatched = "대한민국";
+  ASSERT_TRUE(
+      bitmap.mayContain(matched.data(), matched.data() + matched.size()));
+  ASSERT_TRUE(bitmap.mayContain(ascii.data(), ascii.data() + ascii.size()));
+  ASSERT_FALSE(bitmap.mayContain(unmatched.data(),
+                                 unmatched.data() + unmatched.size()));
 }
 
 TEST(TestDictionary, loadPrebuilt) {
@@ -29,3 +344,179 @@ TEST(TestDictionary, loadPrebuilt) {
   status = dic.loadUser("./dictionary/latest-userdict.txt");
   ASSERT_TRUE(status.ok()) << status.message();
 }
+
+TEST(TestDictionary, loadCompiledUser) {
+  Dictionary dic;
+  auto status = dic.loadPrebuilt("./dictionary/latest-dictionary.nori");
+  ASSERT_TRUE(status.ok()) << status.message();
+  status = dic.loadUser("./dictionary/latest-userdict.txt");
+  ASSERT_TRUE(status.ok()) << status.message();
+  const auto userDictionary = dic.acquireUserDict();
+  status = userDictionary->saveCompiled("userdict.nori");
+  ASSERT_TRUE(status.ok()) << status.message();
+
+  Dictionary compiled;
+  status = compiled.loadPrebuilt("./dictionary/latest-dictionary.nori");
+  ASSERT_TRUE(status.ok()) << status.message();
+  status = compiled.loadUser("userdict.nori");
+  ASSERT_TRUE(status.ok()) << status.message();
+  ASSERT_TRUE(compiled.isUserInitialized());
+
+  const auto compiledUserDictionary = compiled.acquireUserDict();
+  const auto* morphemes = userDictionary->getMorphemes();
+  const auto* compiledMorphemes = compiledUserDictionary->getMorphemes();
+  ASSERT_EQ(morphemes->size(), compiledMorphemes->size());
+  for (int i = 0; i < morphemes->size(); i++) {
+    ASSERT_EQ(morphemes->at(i).SerializeAsString(),
+              compiledMorphemes->at(i).SerializeAsString());
+  }
+
+  int searchResult, compiledSearchResult;
+  userDictionary->getTrie()->exactMatchSearch("세종시", searchResult);
+  compiledUserDictionary->getTrie()->exactMatchSearch("세종시",
+                                                      compiledSearchResult);
+  ASSERT_NE(searchResult, -1);
+  ASSERT_EQ(searchResult, compiledSearchResult);
+  ASSERT_EQ(compiledMorphemes->at(compiledSearchResult).expression(0).surface(),
+            "세종");
+}
+
+TEST(TestDictionary, loadCompactUser) {
+  using nori::protos::KeyEncoding;
+
+  UserDictionary user;
+  auto status = user.load("./dictionary/latest-userdict.txt", 1, 2, 3, 4,
+                          KeyEncoding::HANGUL_COMPACT);
+  ASSERT_TRUE(status.ok()) << status.message();
+  status = user.saveCompiled("compact-userdict.nori");
+  ASSERT_TRUE(status.ok()) << status.message();
+
+  // the key encoding must be equal to the compiled one.
+  UserDictionary compiled;
+  status = compiled.loadCompiled("compact-userdict.nori", 1, 2, 3, 4);
+  ASSERT_FALSE(status.ok());
+  status = compiled.loadCompiled("compact-userdict.nori", 1, 2, 3, 4,
+                                 KeyEncoding::HANGUL_COMPACT);
+  ASSERT_TRUE(status.ok()) << status.message();
+
+  const std::string input = "세종시청에";
+  std::vector<Darts::DoubleArray::result_pair_type> results(16);
+  for (const auto* dictionary : {&user, &compiled}) {
+    size_t length;
+    const auto morpheme = dictionary->findLongestTerm(
+        input.data(), input.data() + input.size(), results.data(),
+        results.size(), length);
+    ASSERT_NE(morpheme, nullptr);
+    ASSERT_EQ(input.substr(0, length), "세종시");
+    ASSERT_EQ(morpheme->expression(0).surface(), "세종");
+  }
+}
+
+TEST(TestDictionary, loadMalformedCompiledUser) {
+  namespace internal = nori::dictionary::internal;
+
+  UserDictionary user;
+  auto status = user.load("./dictionary/latest-userdict.txt", 1, 2, 3, 4);
+  ASSERT_TRUE(status.ok()) << status.message();
+  status = user.saveCompiled("malformed-userdict.nori");
+  ASSERT_TRUE(status.ok()) << status.message();
+
+  std::string data;
+  {
+    std::ifstream ifs("malformed-userdict.nori", std::ios::binary);
+    data.assign(std::istreambuf_iterator<char>(ifs),
+                std::istreambuf_iterator<char>());
+  }
+  internal::UserDictionaryHeader header;
+  ASSERT_GE(data.size(), sizeof(header));
+  std::memcpy(&header, data.data(), sizeof(header));
+  ASSERT_GT(header.numMorphemes, 1);
+
+  const auto write = [](const std::string& data) {
+    std::ofstream ofs("malformed-userdict.nori", std::ios::binary);
+    ofs.write(data.data(), data.size());
+  };
+  UserDictionary compiled;
+
+  // truncated file
+  write(data.substr(0, data.size() - 1));
+  ASSERT_FALSE(compiled.loadCompiled("malformed-userdict.nori", 1, 2, 3, 4)
+                   .ok());
+
+  // keep the first record only, so values of the trie are out of range.
+  const size_t morphemesOffset =
+      sizeof(header) +
+      sizeof(uint64_t) * internal::FirstCodePointBitmap::kNumWords +
+      header.dartsSize;
+  std::string malformed = data;
+  const size_t recordSize = sizeof(internal::UserMorphemeRecord);
+  malformed.erase(morphemesOffset + recordSize,
+                  recordSize * (header.numMorphemes - 1));
+  header.numMorphemes = 1;
+  std::memcpy(&malformed[0], &header, sizeof(header));
+  write(malformed);
+  status = compiled.loadCompiled("malformed-userdict.nori", 1, 2, 3, 4);
+  ASSERT_TRUE(status.ok()) << status.message();
+
+  std::vector<Darts::DoubleArray::result_pair_type> results(16);
+  for (const std::string input : {"세종시청에", "대한민국날씨", "c샤프"}) {
+    size_t length = 0;
+    const auto morpheme = compiled.findLongestTerm(
+        input.data(), input.data() + input.size(), results.data(),
+        results.size(), length);
+    ASSERT_TRUE(morpheme == nullptr ||
+                morpheme == &compiled.getMorphemes()->at(0));
+  }
+}
+
+TEST(TestDictionary, updateUserTerms) {
+  Dictionary dic;
+  auto status = dic.loadPrebuilt("./dictionary/latest-dictionary.nori");
+  ASSERT_TRUE(status.ok()) << status.message();
+
+  // without loaded user dictionary
+  status = dic.addUserTerm("세종시청");
+  ASSERT_TRUE(status.ok()) << status.message();
+  ASSERT_TRUE(dic.isUserInitialized());
+
+  status = dic.loadUser("./dictionary/latest-userdict.txt");
+  ASSERT_TRUE(status.ok()) << status.message();
+  const auto loaded = dic.acquireUserDict();
+
+  const std::string input = "세종시청에";
+  std::vector<Darts::DoubleArray::result_pair_type> results(16);
+  size_t length;
+  const auto findLongestTerm = [&]() {
+    return dic.acquireUserDict()->findLongestTerm(
+        input.data(), input.data() + input.size(), results.data(),
+        results.size(), length);
+  };
+
+  auto morpheme = findLongestTerm();
+  ASSERT_NE(morpheme, nullptr);
+  ASSERT_EQ(input.substr(0, length), "세종시");
+
+  status = dic.addUserTerm("세종시청 세종 시청");
+  ASSERT_TRUE(status.ok()) << status.message();
+  morpheme = findLongestTerm();
+  ASSERT_NE(morpheme, nullptr);
+  ASSERT_EQ(input.substr(0, length), "세종시청");
+  ASSERT_EQ(morpheme->expression(0).surface(), "세종");
+
+  status = dic.removeUserTerm("세종시청");
+  ASSERT_TRUE(status.ok()) << status.message();
+  status = dic.removeUserTerm("세종시");
+  ASSERT_TRUE(status.ok()) << status.message();
+  morpheme = findLongestTerm();
+  ASSERT_NE(morpheme, nullptr);
+  ASSERT_EQ(input.substr(0, length), "세종");
+
+  status = dic.removeUserTerm("세종시");
+  ASSERT_TRUE(absl::IsNotFound(status));
+
+  // updates are not visible to the previous version.
+  morpheme = loaded->findLongestTerm(input.data(), input.data() + input.size(),
+                                     results.data(), results.size(), length);
+  ASSERT_NE(morpheme, nullptr);
+  ASSERT_EQ(input.substr(0, length), "세종시");
+}
@@ -0,0 +1,83 @@
+#include "nori/lib/dictionary/registry.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include "absl/strings/str_cat.h"
+
+namespace nori {
+namespace dictionary {
+
+namespace {
+
+// append the real path and the version of the file to `key`. The version of a
+// missing file is empty, so loading it reports the error.
+void appendFileKey(const std::string& path, std::string& key) {
+  char realPath[PATH_MAX];
+  struct stat s;
+  if (realpath(path.c_str(), realPath) == nullptr ||
+      stat(realPath, &s) != 0) {
+    absl::StrAppend(&key, path, "\n\n");
+    return;
+  }
+  absl::StrAppend(&key, realPath, "\n", s.st_ino, ":", s.st_size, ":",
+                  s.st_mtim.tv_sec, ".", s.st_mtim.tv_nsec, "\n");
+}
+
+}  // namespace
+
+DictionaryRegistry& DictionaryRegistry::global() {
+  // never destroyed, so handles can be released at exit
+  static DictionaryRegistry* registry = new DictionaryRegistry();
+  return *registry;
+}
+
+absl::Status DictionaryRegistry::acquire(
+    const std::string& path, const std::string& userPath,
+    std::shared_ptr<const Dictionary>& output) {
+  std::string key;
+  appendFileKey(path, key);
+  if (!userPath.empty()) appendFileKey(userPath, key);
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto found = dictionaries.find(key);
+  if (found != dictionaries.end()) {
+    output = found->second.lock();
+    if (output != nullptr) return absl::OkStatus();
+  }
+
+  auto dictionary = std::make_shared<Dictionary>();
+  auto status = dictionary->loadPrebuilt(path);
+  if (!status.ok())
+    return absl::FailedPreconditionError(absl::StrCat(
+        "Cannot load dictionary ", path, ": ", status.message()));
+  if (!userPath.empty()) {
+    status = dictionary->loadUser(userPath);
+    if (!status.ok())
+      return absl::InvalidArgumentError(absl::StrCat(
+          "Cannot load user dictionary ", userPath, ": ", status.message()));
+  }
+
+  // drop dictionaries that are freed
+  for (auto it = dictionaries.begin(); it != dictionaries.end();) {
+    if (it->second.expired())
+      it = dictionaries.erase(it);
+    else
+      it++;
+  }
+  dictionaries[key] = dictionary;
+  output = std::move(dictionary);
+  return absl::OkStatus();
+}
+
+size_t DictionaryRegistry::size() {
+  std::lock_guard<std::mutex> lock(mutex);
+  size_t numDictionaries = 0;
+  for (const auto& entry : dictionaries)
+    if (!entry.second.expired()) numDictionaries++;
+  return numDictionaries;
+}
+
+}  // namespace dictionary
+}  // namespace nori
@@ -0,0 +1,51 @@
+#ifndef __NORI_DICTIONARY_REGISTRY_H__
+#define __NORI_DICTIONARY_REGISTRY_H__
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "absl/status/status.h"
+#include "nori/lib/dictionary/dictionary.h"
+
+namespace nori {
+namespace dictionary {
+
+// Process-wide registry of loaded dictionaries.
+//
+// Tokenizer handles of the C, Python and Go APIs acquire dictionaries from
+// the registry, so a dictionary is loaded once while any handle holds it and
+// is freed with the last handle. Dictionaries are keyed by the paths of their
+// files and the versions of the files (inode, size and modification time), so
+// a rewritten file is loaded again.
+//
+// Shared dictionaries are const. To use another user dictionary, acquire the
+// dictionary with its path instead of reloading the user dictionary.
+class DictionaryRegistry {
+ public:
+  // the registry of the process
+  static DictionaryRegistry& global();
+
+  // acquire the dictionary loaded from `path` and `userPath`. The user
+  // dictionary is not loaded if `userPath` is empty. Dictionaries are loaded
+  // one at a time.
+  //
+  // A failure of loading the prebuilt dictionary is returned as
+  // FailedPreconditionError, and a failure of loading the user dictionary as
+  // InvalidArgumentError.
+  absl::Status acquire(const std::string& path, const std::string& userPath,
+                       std::shared_ptr<const Dictionary>& output);
+
+  // return the number of dictionaries that are held by any handle
+  size_t size();
+
+ private:
+  std::mutex mutex;
+  std::map<std::string, std::weak_ptr<const Dictionary>> dictionaries;
+};
+
+}  // namespace dictionary
+}  // namespace nori
+
+#endif  // __NORI_DICTIONARY_REGISTRY_H__
@@ -0,0 +1,43 @@
+#include "nori/lib/dictionary/registry.h"
+
+#include <gtest/gtest.h>
+
+using namespace nori::dictionary;
+
+TEST(TestDictionaryRegistry, acquire) {
+  DictionaryRegistry registry;
+  std::shared_ptr<const Dictionary> dictionary, sameDictionary, userDictionary;
+  auto status = registry.acquire("./dictionary/latest-dictionary.nori", "",
+                                 dictionary);
+  ASSERT_TRUE(status.ok()) << status.message();
+  status = registry.acquire("./dictionary/../dictionary/latest-dictionary.nori",
+                            "", sameDictionary);
+  ASSERT_TRUE(status.ok()) << status.message();
+  ASSERT_EQ(dictionary, sameDictionary);
+  ASSERT_FALSE(dictionary->isUserInitialized());
+
+  status = registry.acquire("./dictionary/latest-dictionary.nori",
+                            "./dictionary/latest-userdict.txt",
+                            userDictionary);
+  ASSERT_TRUE(status.ok()) << status.message();
+  ASSERT_NE(dictionary, userDictionary);
+  ASSERT_TRUE(userDictionary->isUserInitialized());
+  ASSERT_EQ(registry.size(), 2);
+
+  // dictionaries are freed with the last handle.
+  userDictionary.reset();
+  ASSERT_EQ(registry.size(), 1);
+  dictionary.reset();
+  ASSERT_EQ(registry.size(), 1);
+  sameDictionary.reset();
+  ASSERT_EQ(registry.size(), 0);
+
+  // failures tell which dictionary cannot be loaded.
+  ASSERT_TRUE(absl::IsFailedPrecondition(registry.acquire(
+      "./dictionary/missing.nori", "./dictionary/latest-userdict.txt",
+      dictionary)));
+  ASSERT_TRUE(absl::IsInvalidArgument(
+      registry.acquire("./dictionary/latest-dictionary.nori",
+                       "./dictionary/missing.txt", dictionary)));
+  ASSERT_EQ(registry.size(), 0);
+}
@@ -54,7 +54,7 @@ void GraphvizVisualizer::addNode(size_t fromIndex, size_t fromNodeId,
                                  const nori::protos::Morpheme* fromMorpheme,
                                  size_t toIndex, size_t toNodeId,
                                  const nori::protos::Morpheme* toMorpheme,
-                                 const std::string stringForm, int wordCost,
+                                 absl::string_view stringForm, int wordCost,
                                  int connectionCost, int cost) {
   auto fromNodeLabel = internal::getNodeLabel(fromIndex, fromNodeId);
   auto toNodeLabel = internal::getNodeLabel(toIndex, toNodeId);
@@ -3,12 +3,16 @@
 
 #include <string>
 
+#include "absl/strings/string_view.h"
 #include "nori/lib/protos/dictionary.pb.h"
 
 namespace nori {
 
 // Visualizing tokenizer path using dotfile format.
 //
+// This is one of the lattice observers of nori::NoriTokenizer. (see
+// nori::NoopObserver for the interface)
+//
 // you can convert the output of GraphvizVisualizer::str to png using below
 // command.
 //   dot -Tpng path-to-dotfile > outfile.png
@@ -23,6 +27,9 @@ class GraphvizVisualizer {
         bosLabel(bosLabel),
         eosLabel(eosLabel) {}
 
+  // draw all nodes of the lattice
+  static constexpr bool keepDominatedNodes = true;
+
   // clear internal states
   void reset();
 
@@ -30,7 +37,7 @@ class GraphvizVisualizer {
   void addNode(size_t fromIndex, size_t fromNodeId,
                const nori::protos::Morpheme* fromMorpheme, size_t toIndex,
                size_t toNodeId, const nori::protos::Morpheme* toMorpheme,
-               const std::string stringForm, int wordCost, int connectionCost,
+               absl::string_view stringForm, int wordCost, int connectionCost,
                int cost);
 
   // add final node path
@@ -3,16 +3,18 @@
 #include <darts.h>
 #include <google/protobuf/repeated_field.h>
 
+#include <algorithm>
+#include <cstring>
 #include <map>
 #include <memory>
 #include <queue>
+#include <unordered_map>
 #include <vector>
 
 #include "absl/log/log.h"
-#include "icu4c/source/common/unicode/uchar.h"
-#include "icu4c/source/common/unicode/uscript.h"
 #include "icu4c/source/common/unicode/utf.h"
 #include "nori/lib/protos/dictionary.pb.h"
+#include "nori/lib/unicode_properties.h"
 #include "nori/lib/utils.h"
 
 namespace nori {
@@ -58,89 +60,219 @@ int getSpacePenalty(const nori::protos::Morpheme* morpheme, int numSpaces) {
   }
 }
 
-inline bool isCommonOrInherited(UScriptCode sc) {
-  return sc == USCRIPT_COMMON || sc == USCRIPT_INHERITED;
-}
+void UnknownWordRuns::build(absl::string_view sentence) {
+  const char* begin = sentence.data();
+  const size_t length = sentence.size();
+  indices.assign(length + 1, 0);
+  offsets.clear();
+  flags.clear();
+  scripts.clear();
 
-inline bool isPunctuation(UChar32 ch) {
-  if (ch == 4510) {  // Hangul Letter Araea
-    return true;
+  size_t offset = 0;
+  while (offset < length) {
+    indices[offset] = offsets.size();
+    offsets.push_back(offset);
+
+    UChar32 c;
+    U8_NEXT_UNSAFE(begin, offset, c);
+    const uint16_t properties = unicode::getProperties(c);
+    uint8_t flag = 0;
+    if (unicode::isInvalid(properties)) flag |= kBreak | kFailure;
+    if (unicode::isWhiteSpace(properties)) flag |= kBreak;
+    if (unicode::isPunctuation(properties)) flag |= kPunctuation;
+    if (unicode::isDigit(properties)) flag |= kDigit;
+    if (unicode::isCommonOrInherited(properties)) flag |= kCommon;
+    flags.push_back(flag);
+    scripts.push_back(unicode::getScript(properties));
+  }
+  indices[length] = offsets.size();
+  offsets.push_back(length);
+
+  // positions of the next boundaries from right to left. The last element
+  // is the end of the sentence.
+  const int size = flags.size();
+  nextBreak.assign(size + 1, size);
+  nextPunctuation.assign(size + 1, size);
+  nextNonPunctuation.assign(size + 1, size);
+  nextDigit.assign(size + 1, size);
+  nextNonDigit.assign(size + 1, size);
+  nextNonCommon.assign(size + 1, size);
+  nextOtherScript.assign(size + 1, size);
+  for (int i = size - 1; i >= 0; i--) {
+    const uint8_t flag = flags[i];
+    nextBreak[i] = flag & kBreak ? i : nextBreak[i + 1];
+    nextPunctuation[i] = flag & kPunctuation ? i : nextPunctuation[i + 1];
+    nextNonPunctuation[i] =
+        flag & kPunctuation ? nextNonPunctuation[i + 1] : i;
+    nextDigit[i] = flag & kDigit ? i : nextDigit[i + 1];
+    nextNonDigit[i] = flag & kDigit ? nextNonDigit[i + 1] : i;
+    nextNonCommon[i] = flag & kCommon ? nextNonCommon[i + 1] : i;
+
+    // the first non-common character after i with another script
+    if (!(flag & kCommon)) {
+      const int next = nextNonCommon[i + 1];
+      nextOtherScript[i] = next == size || scripts[next] != scripts[i]
+                               ? next
+                               : nextOtherScript[next];
+    }
   }
 
-  switch (u_charType(ch)) {
-    case UCharCategory::U_SPACE_SEPARATOR:
-    case UCharCategory::U_LINE_SEPARATOR:
-    case UCharCategory::U_PARAGRAPH_SEPARATOR:
-    case UCharCategory::U_CONTROL_CHAR:
-    case UCharCategory::U_FORMAT_CHAR:
-    case UCharCategory::U_DASH_PUNCTUATION:
-    case UCharCategory::U_START_PUNCTUATION:
-    case UCharCategory::U_END_PUNCTUATION:
-    case UCharCategory::U_CONNECTOR_PUNCTUATION:
-    case UCharCategory::U_OTHER_PUNCTUATION:
-    case UCharCategory::U_MATH_SYMBOL:
-    case UCharCategory::U_CURRENCY_SYMBOL:
-    case UCharCategory::U_MODIFIER_SYMBOL:
-    case UCharCategory::U_OTHER_SYMBOL:
-    case UCharCategory::U_INITIAL_PUNCTUATION:
-    case UCharCategory::U_FINAL_PUNCTUATION:
-      return true;
+  lastNonPunctuation.assign(size, -1);
+  for (int i = 0; i < size; i++) {
+    lastNonPunctuation[i] = flags[i] & kPunctuation
+                                ? (i > 0 ? lastNonPunctuation[i - 1] : -1)
+                                : i;
   }
-  return false;
+
+  built = true;
 }
 
-int groupingUnknownCharacters(const char* begin, const char* end,
-                              nori::protos::CharacterClass& category,
-                              const nori::dictionary::Dictionary* dictionary,
-                              const bool doGroup) {
-  UChar32 currentChar;
-  size_t length = end - begin;
-  size_t offset = 0;
-  size_t offsetToReturn;
-  U8_NEXT_UNSAFE(begin, offset, currentChar);
-
-  UErrorCode err = U_ZERO_ERROR;
-  auto firstUScript = uscript_getScript(currentChar, &err);
-  bool isFirstCommonOrInherited = isCommonOrInherited(firstUScript);
-  bool isFirstPunctuation = isPunctuation(currentChar);
-  bool isFirstDigit = u_isdigit(currentChar);
-  if (U_FAILURE(err)) {
-    return offset;
+int UnknownWordRuns::getLength(const char* begin, size_t offset,
+                               nori::protos::CharacterClass& category,
+                               const nori::dictionary::Dictionary* dictionary,
+                               const bool doGroup) const {
+  const int i = indices[offset];
+  const uint8_t flag = flags[i];
+  if (!doGroup || (flag & kFailure)) return offsets[i + 1] - offset;
+
+  int last = nextBreak[i + 1];
+  last = std::min(last, flag & kPunctuation ? nextNonPunctuation[i + 1]
+                                            : nextPunctuation[i + 1]);
+  last = std::min(last,
+                  flag & kDigit ? nextNonDigit[i + 1] : nextDigit[i + 1]);
+  if (flag & kCommon) {
+    const int lastNonPunctuationIndex = lastNonPunctuation[last - 1];
+    if (lastNonPunctuationIndex > i)
+      category = dictionary->getCharClass(
+          begin + offsets[lastNonPunctuationIndex], begin + offsets.back());
+  } else {
+    last = std::min(last, nextOtherScript[i]);
   }
 
-  if (!doGroup) {
-    return offset;
+  return offsets[last] - offset;
+}
+
+// Terms of the dictionary that are found in a sentence with the Aho-Corasick
+// automaton, grouped by their start offsets. All terms are matched in a single
+// pass, instead of searching the trie from every position.
+class LexiconMatches {
+ public:
+  void build(const nori::dictionary::AhoCorasick& ahoCorasick,
+             absl::string_view sentence) {
+    found.clear();
+    offsets.clear();
+    ahoCorasick.match(sentence, [&](size_t offset, int length, int value) {
+      found.push_back({value, static_cast<size_t>(length)});
+      offsets.push_back(offset);
+    });
+
+    // counting sort by start offsets. Matches are found in order of their end
+    // offsets, so matches of each start offset are sorted by length like the
+    // results of the trie.
+    begins.assign(sentence.size() + 2, 0);
+    for (const auto offset : offsets) begins[offset + 2]++;
+    for (int i = 2; i < begins.size(); i++) begins[i] += begins[i - 1];
+    matches.resize(found.size());
+    for (int i = 0; i < found.size(); i++)
+      matches[begins[offsets[i] + 1]++] = found[i];
   }
 
-  while (offset < length) {
-    offsetToReturn = offset;
-    U8_NEXT_UNSAFE(begin, offset, currentChar);
-    auto currentUScript = uscript_getScript(currentChar, &err);
-    if (U_FAILURE(err)) {
-      return offsetToReturn;
-    }
+  // copy matches that start at `offset` into `results`, and return the number
+  // of all the matches.
+  size_t get(size_t offset, Darts::DoubleArray::result_pair_type* results,
+             size_t maxResults) const {
+    const size_t numMatches = begins[offset + 1] - begins[offset];
+    std::copy_n(matches.begin() + begins[offset],
+                std::min(numMatches, maxResults), results);
+    return numMatches;
+  }
 
-    bool isCurrentCommonOrInherited = isCommonOrInherited(currentUScript);
-    bool isSameScript =
-        ((firstUScript == currentUScript) || isFirstCommonOrInherited ||
-         isCurrentCommonOrInherited) &&
-        !u_hasBinaryProperty(currentChar, UCHAR_WHITE_SPACE);
-    bool isCurrentPunctuation = isPunctuation(currentChar);
-    bool isCurrentDigit = u_isdigit(currentChar);
-
-    if (!isSameScript || (isFirstPunctuation != isCurrentPunctuation) ||
-        (isFirstDigit != isCurrentDigit)) {
-      return offsetToReturn;
-    }
+ private:
+  // matches of the offset i are in [begins[i], begins[i + 1])
+  std::vector<size_t> begins;
+  std::vector<Darts::DoubleArray::result_pair_type> matches;
+  // matches in order of their end offsets
+  std::vector<Darts::DoubleArray::result_pair_type> found;
+  std::vector<size_t> offsets;
+};
 
-    if (isFirstCommonOrInherited && !isCurrentPunctuation) {
-      firstUScript = currentUScript;
-      category = dictionary->getCharClass(begin + offsetToReturn, end);
+// Trie results of the positions of a sentence.
+//
+// A search only depends on the bytes that the trie reads from its start, so
+// the results of a position are reused for later positions that start with
+// the same bytes. Repeated substrings of a document skip the trie, and the
+// results are the same as searching the trie. Entries are chained by their
+// first bytes for lookups.
+class TrieMemo {
+ public:
+  // forget results of the previous text
+  void clear() {
+    heads.clear();
+    entries.clear();
+    memoResults.clear();
+  }
+
+  size_t search(const nori::dictionary::Dictionary* dictionary,
+                const char* begin, const char* end,
+                Darts::DoubleArray::result_pair_type* results,
+                size_t maxResults) {
+    const size_t length = end - begin;
+    const uint64_t key = getKey(begin, length);
+    auto found = heads.find(key);
+    for (int i = found != heads.end() ? found->second : -1; i >= 0;
+         i = entries[i].next) {
+      const Entry& entry = entries[i];
+      // a search that reads to the end of the text is only reused at the same
+      // distance from the end.
+      if (entry.readsToEnd ? length != entry.numReadBytes
+                           : length < entry.numReadBytes)
+        continue;
+      if (std::memcmp(begin, entry.begin, entry.numReadBytes) != 0) continue;
+
+      std::copy_n(memoResults.begin() + entry.resultsBegin,
+                  std::min(entry.numResults, maxResults), results);
+      return entry.numResults;
     }
+
+    size_t numReadBytes;
+    const size_t numResults = dictionary->commonPrefixSearch(
+        begin, end, results, maxResults, numReadBytes);
+    if (numResults > maxResults) return numResults;
+
+    entries.push_back({begin, numReadBytes, numReadBytes == length,
+                       memoResults.size(), numResults,
+                       found != heads.end() ? found->second : -1});
+    heads[key] = entries.size() - 1;
+    memoResults.insert(memoResults.end(), results, results + numResults);
+    return numResults;
   }
 
-  return offset;
-}
+ private:
+  struct Entry {
+    // bytes that the search reads
+    const char* begin;
+    size_t numReadBytes;
+    bool readsToEnd;
+    // results in memoResults
+    size_t resultsBegin;
+    size_t numResults;
+    // the previous entry with the same key, or -1
+    int next;
+  };
+
+  // the first 7 bytes and their length
+  static uint64_t getKey(const char* begin, size_t length) {
+    const size_t size = std::min<size_t>(length, 7);
+    uint64_t key = size;
+    for (size_t i = 0; i < size; i++)
+      key = (key << 8) | static_cast<unsigned char>(begin[i]);
+    return key;
+  }
+
+  std::unordered_map<uint64_t, int> heads;
+  std::vector<Entry> entries;
+  std::vector<Darts::DoubleArray::result_pair_type> memoResults;
+};
 
 TrieNode* selectParent(std::vector<internal::TrieNode>& candidates,
                        const nori::protos::Morpheme* morpheme,
@@ -168,32 +300,322 @@ TrieNode* selectParent(std::vector<internal::TrieNode>& candidates,
   return &candidates[result];
 }
 
+// Best parents of the nodes that start at the current position by left ids.
+//
+// Many morphemes that start at the same position share a left id, and the
+// best parent only depends on the left id. The parent is selected once per
+// distinct left id, so the work of a position is O(candidates x distinct left
+// ids) instead of O(candidates x morphemes).
+class BestParents {
+ public:
+  // forget all parents, and resize the slots for `numLeftIds` left ids. Slots
+  // are kept if the number of left ids is not changed, so only the touched
+  // slots are reset.
+  void reset(int numLeftIds) {
+    numLeftIds = std::max(numLeftIds, 0);
+    if (slots.size() == static_cast<size_t>(numLeftIds)) {
+      clear();
+      return;
+    }
+    slots.assign(numLeftIds, -1);
+    entries.clear();
+  }
+
+  // forget the parents of the previous position. Candidates of a position are
+  // final when its nodes are added, because every node ends after its start.
+  void clear() {
+    for (const auto& entry : entries) slots[entry.leftId] = -1;
+    entries.clear();
+  }
+
+  TrieNode* select(std::vector<TrieNode>& candidates,
+                   const nori::protos::Morpheme* morpheme,
+                   const nori::dictionary::Dictionary* dictionary,
+                   int& connectionCost) {
+    const int leftId = morpheme->left_id();
+    if (leftId < 0 || leftId >= slots.size())
+      return selectParent(candidates, morpheme, dictionary, connectionCost);
+
+    if (slots[leftId] < 0) {
+      Entry entry{leftId, nullptr, 0};
+      entry.parent = selectParent(candidates, morpheme, dictionary,
+                                  entry.connectionCost);
+      slots[leftId] = entries.size();
+      entries.push_back(entry);
+    }
+    const Entry& entry = entries[slots[leftId]];
+    connectionCost = entry.connectionCost;
+    return entry.parent;
+  }
+
+ private:
+  struct Entry {
+    int leftId;
+    TrieNode* parent;
+    int connectionCost;
+  };
+
+  // index of the entry by left ids, or -1
+  std::vector<int> slots;
+  std::vector<Entry> entries;
+};
+
+// Buffers of NoriTokenizer::tokenize. They are kept in a lattice, so the next
+// tokenization with the lattice reuses them.
+struct TokenizerScratch {
+  // nodes by their end positions
+  std::vector<std::vector<TrieNode>> nodesByPos;
+  std::vector<Darts::DoubleArray::result_pair_type> trieResults;
+  std::vector<size_t> userNodeLengths;
+  UnknownWordRuns unknownWordRuns;
+  LexiconMatches lexiconMatches;
+  TrieMemo trieMemo;
+  BestParents bestParents;
+  // nodes of the best path
+  std::vector<TrieNode*> path;
+  // a snapshot of the user dictionaries of the current tokenization
+  std::vector<const nori::dictionary::UserDictionary*> userDictionaries;
+};
+
+// Add a node of the morpheme that starts at `offset + numSpaces`. The parent
+// node is selected among the nodes ending at `offset`.
+template <class Observer>
+inline void addNode(std::vector<std::vector<TrieNode>>& nodesByPos,
+                    const int offset, const int numSpaces, const int length,
+                    const nori::protos::Morpheme* morpheme,
+                    const nori::dictionary::Dictionary* dictionary,
+                    BestParents& bestParents, const char* begin, int& nodeId,
+                    Observer& observer) {
+  const int wordCost = morpheme->word_cost();
+  const int spaceCost = getSpacePenalty(morpheme, numSpaces);
+  int connectionCost;
+  TrieNode* parent = bestParents.select(nodesByPos[offset], morpheme,
+                                        dictionary, connectionCost);
+
+  const int lastPositionIndex =
+      parent->lastPositionIndex + numSpaces + length;
+  const int lastNodeId = nodeId;
+  const int cost = parent->cost + wordCost + connectionCost + spaceCost;
+  auto& nodes = nodesByPos[lastPositionIndex];
+  bool isDominated = false;
+  if constexpr (!Observer::keepDominatedNodes) {
+    // Nodes that end at the same position with the same right id have the
+    // same connection costs to every next node, so only the cheapest one can
+    // be on the best path. On the same cost, the earlier node wins like in
+    // selectParent. No node refers to `nodes` yet, because they end after the
+    // current position, and the order of the remaining nodes is kept.
+    auto sameRightId = std::find_if(
+        nodes.begin(), nodes.end(), [&](const TrieNode& node) {
+          return node.morpheme->right_id() == morpheme->right_id();
+        });
+    if (sameRightId != nodes.end()) {
+      isDominated = sameRightId->cost <= cost;
+      if (!isDominated) nodes.erase(sameRightId);
+    }
+  }
+  if (!isDominated)
+    nodes.emplace_back(nodeId, cost, lastPositionIndex, length, morpheme,
+                       parent);
+  nodeId++;
+
+  observer.addNode(
+      parent->lastPositionIndex - parent->length, parent->uniqueNodeId,
+      parent->morpheme, parent->lastPositionIndex + numSpaces, lastNodeId,
+      morpheme,
+      absl::string_view(begin + parent->lastPositionIndex + numSpaces, length),
+      wordCost, connectionCost, cost);
+}
+
 }  // namespace internal
 
+Lattice::Lattice() {}
+Lattice::~Lattice() {}
+Lattice::Lattice(Lattice&& other) noexcept = default;
+Lattice& Lattice::operator=(Lattice&& other) noexcept = default;
+
+internal::TokenizerScratch* Lattice::getScratch() {
+  if (scratch == nullptr)
+    scratch = std::make_unique<internal::TokenizerScratch>();
+  return scratch.get();
+}
+
 // NoriTokenizer class
 typedef Darts::DoubleArray::result_pair_type DartsResults;
 
 absl::Status NoriTokenizer::tokenize(Lattice& lattice,
                                      GraphvizVisualizer* visualizer) const {
+  return tokenize(lattice, {}, visualizer);
+}
+
+absl::Status NoriTokenizer::tokenize(
+    Lattice& lattice,
+    const std::vector<std::shared_ptr<const dictionary::UserDictionary>>&
+        overlays,
+    GraphvizVisualizer* visualizer) const {
+  // a snapshot of the user dictionary. The user dictionary can be reloaded
+  // while tokenizing.
+  auto& userDictionaries = lattice.getScratch()->userDictionaries;
+  userDictionaries.clear();
+  auto userDictionary = dictionary->acquireUserDict();
+  if (userDictionary != nullptr)
+    userDictionaries.push_back(userDictionary.get());
+  lattice.keepUserDictionary(std::move(userDictionary));
+  for (const auto& overlay : overlays) {
+    if (overlay == nullptr) continue;
+    userDictionaries.push_back(overlay.get());
+    lattice.keepUserDictionary(overlay);
+  }
+
   if (visualizer != nullptr) {
-    visualizer->reset();
+    if (!userDictionaries.empty())
+      return tokenize<GraphvizVisualizer, true>(
+          lattice, *visualizer, userDictionaries, lattice.getSentence());
+    return tokenize<GraphvizVisualizer, false>(
+        lattice, *visualizer, userDictionaries, lattice.getSentence());
   }
 
+  NoopObserver observer;
+  if (!userDictionaries.empty())
+    return tokenize<NoopObserver, true>(lattice, observer, userDictionaries,
+                                        lattice.getSentence());
+  return tokenize<NoopObserver, false>(lattice, observer, userDictionaries,
+                                       lattice.getSentence());
+}
+
+absl::Status NoriTokenizer::tokenize(Lattice& lattice,
+                                     EojeolCache& cache) const {
+  // cached paths refer to morphemes of the user dictionary, so the cache is
+  // cleared when the user dictionary is reloaded.
+  auto userDictionary = dictionary->acquireUserDict();
+  if (cache.dictionary != dictionary ||
+      cache.userDictionary != userDictionary) {
+    cache.clear();
+    cache.dictionary = dictionary;
+    cache.userDictionary = userDictionary;
+  }
+  auto& userDictionaries = lattice.getScratch()->userDictionaries;
+  userDictionaries.clear();
+  if (userDictionary != nullptr)
+    userDictionaries.push_back(userDictionary.get());
+  lattice.keepUserDictionary(std::move(userDictionary));
+
+  const nori::protos::Morpheme* bosEosMorpheme =
+      dictionary->getBosEosMorpheme();
+  const absl::string_view sentence = lattice.getSentence();
+  auto outputTokens = lattice.getMutableTokens();
+  outputTokens->emplace_back(dictionary->getBosEosSurface(), bosEosMorpheme,
+                             0, 0);
+
+  NoopObserver observer;
+  const nori::protos::Morpheme* leftContext = bosEosMorpheme;
+  std::string key;
+  size_t offset = 0;
+  while (true) {
+    size_t wordBegin = offset;
+    while (wordBegin < sentence.size() && std::isspace(sentence[wordBegin]))
+      wordBegin++;
+    if (wordBegin == sentence.size()) break;
+    size_t wordEnd = wordBegin;
+    while (wordEnd < sentence.size() && !std::isspace(sentence[wordEnd]))
+      wordEnd++;
+    const auto word = sentence.substr(wordBegin, wordEnd - wordBegin);
+
+    // the right id of the previous token and the space penalty change the
+    // best path of an eojeol.
+    const int32_t rightId = leftContext->right_id();
+    key.assign(reinterpret_cast<const char*>(&rightId), sizeof(rightId));
+    key.push_back(wordBegin > offset ? ' ' : '\0');
+    key.append(word.data(), word.size());
+
+    auto found = cache.entries.find(key);
+    if (found != cache.entries.end()) {
+      cache.numHits++;
+      for (const auto& token : found->second)
+        outputTokens->emplace_back(
+            sentence.substr(wordBegin + token.offset, token.length),
+            token.morpheme, wordBegin + token.offset, token.length);
+    } else {
+      cache.numMisses++;
+      // the lattice of the eojeol and its leading whitespaces
+      const auto text = sentence.substr(offset, wordEnd - offset);
+      const size_t numTokens = outputTokens->size();
+      auto status =
+          userDictionaries.empty()
+              ? tokenize<NoopObserver, false>(lattice, observer,
+                                              userDictionaries, text,
+                                              leftContext)
+              : tokenize<NoopObserver, true>(lattice, observer,
+                                             userDictionaries, text,
+                                             leftContext);
+      if (!status.ok()) return status;
+
+      if (cache.entries.size() >= cache.maxEntries) cache.entries.clear();
+      auto& cachedTokens = cache.entries[key];
+      for (size_t i = numTokens; i < outputTokens->size(); i++) {
+        const auto& token = outputTokens->at(i);
+        cachedTokens.push_back(
+            {token.offset - wordBegin, token.length, token.morpheme});
+      }
+    }
+
+    leftContext = outputTokens->back().morpheme;
+    offset = wordEnd;
+  }
+
+  outputTokens->emplace_back(dictionary->getBosEosSurface(), bosEosMorpheme,
+                             sentence.size(), 0);
+  return absl::OkStatus();
+}
+
+template <class Observer, bool useUserDictionary>
+absl::Status NoriTokenizer::tokenize(
+    Lattice& lattice, Observer& observer,
+    const std::vector<const dictionary::UserDictionary*>& userDictionaries,
+    absl::string_view inputText,
+    const nori::protos::Morpheme* leftContext) const {
+  observer.reset();
+  internal::TokenizerScratch& scratch = *lattice.getScratch();
+  // slots of the previous tokenization are reset if they are touched
+  internal::BestParents& bestParents = scratch.bestParents;
+  bestParents.reset(dictionary->getConnectionCosts()->backward_size());
+
   const nori::protos::Morpheme* bosEosMorpheme =
       this->dictionary->getBosEosMorpheme();
-  absl::string_view inputText = lattice.getSentence();
+  // offset of `inputText` in the sentence
+  const size_t textOffset = inputText.data() - lattice.getSentence().data();
 
   const char* begin = inputText.begin();
   const char* current = begin;
   const char* end = inputText.end();
-  std::vector<DartsResults> trieResults(maxTrieResults + 1);
+  auto& trieResults = scratch.trieResults;
+  if (trieResults.size() < maxTrieResults + 1)
+    trieResults.resize(maxTrieResults + 1);
+  auto& userNodeLengths = scratch.userNodeLengths;
+  if (userNodeLengths.size() < userDictionaries.size())
+    userNodeLengths.resize(userDictionaries.size());
+  // built at the first unknown word
+  auto& unknownWordRuns = scratch.unknownWordRuns;
+  unknownWordRuns.clear();
+  // terms of the whole sentence if the dictionary has the Aho-Corasick
+  // automaton
+  const auto* ahoCorasick = dictionary->getAhoCorasick();
+  auto& lexiconMatches = scratch.lexiconMatches;
+  if (ahoCorasick != nullptr) lexiconMatches.build(*ahoCorasick, inputText);
+  // trie results of the text if memoizeTrieResults
+  auto& trieMemo = scratch.trieMemo;
+  if (memoizeTrieResults) trieMemo.clear();
 
   int nodeId = 0;
-  std::vector<std::vector<internal::TrieNode>> nodesByPos(inputText.length() +
-                                                          1);
+  // nodes of the previous tokenization are cleared, and their buffers are kept
+  auto& nodesByPos = scratch.nodesByPos;
+  if (nodesByPos.size() < inputText.length() + 1)
+    nodesByPos.resize(inputText.length() + 1);
+  for (size_t i = 0; i <= inputText.length(); i++) nodesByPos[i].clear();
 
-  // bos node;
-  nodesByPos[0].emplace_back(nodeId++, 0, 0, 0, bosEosMorpheme);
+  // bos node, or the node of the left context
+  nodesByPos[0].emplace_back(
+      nodeId++, 0, 0, 0,
+      leftContext != nullptr ? leftContext : bosEosMorpheme);
 
   int offset = 0, numSpaces = 0;
   while ((current = begin + offset) < end) {
@@ -212,61 +634,48 @@ absl::Status NoriTokenizer::tokenize(Lattice& lattice,
     if (current == end) {
       break;
     }
-
-    // find user dictionary
-    if (dictionary->isUserInitialized()) {
-      const int numNodes =
-          dictionary->getUserDict()->getTrie()->commonPrefixSearch(
-              current, trieResults.data(), maxTrieResults,
-              static_cast<int>(end - current));
-
-      if (numNodes != 0) {
-        int index = 0;
-
-        if (numNodes > 0) {
-          // add longest user input
-          int length = trieResults[0].length;
-          for (int i = 1; i < numNodes; i++) {
-            if (length < trieResults[i].length) {
-              length = trieResults[i].length;
-              index = i;
-            }
-          }
-        }
-
-        const auto morpheme = &dictionary->getUserDict()->getMorphemes()->at(
-            trieResults[index].value);
-
-        int wordCost = morpheme->word_cost();
-        int spaceCost = internal::getSpacePenalty(morpheme, numSpaces);
-        int connectionCost;
-        internal::TrieNode* parent = internal::selectParent(
-            nodesByPos[offset], morpheme, this->dictionary, connectionCost);
-
-        int lastPositionIndex =
-            parent->lastPositionIndex + numSpaces + trieResults[index].length;
-        int lastNodeId = nodeId;
-        int cost = parent->cost + wordCost + connectionCost + spaceCost;
-        nodesByPos[lastPositionIndex].emplace_back(
-            nodeId++, cost, lastPositionIndex, trieResults[index].length,
-            morpheme, parent);
-
-        if (visualizer != nullptr) {
-          visualizer->addNode(
-              parent->lastPositionIndex - parent->length, parent->uniqueNodeId,
-              parent->morpheme, parent->lastPositionIndex + numSpaces,
-              lastNodeId, morpheme,
-              std::string(begin + (parent->lastPositionIndex + numSpaces),
-                          begin + lastPositionIndex),
-              wordCost, connectionCost, cost);
-        }
+    bestParents.clear();
+
+    // find user dictionaries from the top of the stack. A user entry shadows
+    // entries of the same length in the lower user dictionaries.
+    if (useUserDictionary) {
+      size_t numUserNodes = 0;
+      for (auto it = userDictionaries.rbegin(); it != userDictionaries.rend();
+           it++) {
+        size_t length;
+        const auto morpheme = (*it)->findLongestTerm(
+            current, end, trieResults.data(), maxTrieResults, length);
+        if (morpheme == nullptr) continue;
+
+        const auto userNodeLengthsEnd =
+            userNodeLengths.begin() + numUserNodes;
+        if (std::find(userNodeLengths.begin(), userNodeLengthsEnd, length) !=
+            userNodeLengthsEnd)
+          continue;
+        userNodeLengths[numUserNodes++] = length;
+
+        internal::addNode(nodesByPos, offset, numSpaces, length, morpheme,
+                          this->dictionary, bestParents, begin, nodeId,
+                          observer);
       }
     }
 
-    // pre-built dictionary
-    const int numNodes = dictionary->getTrie()->commonPrefixSearch(
-        current, trieResults.data(), maxTrieResults,
-        static_cast<int>(end - current));
+    // pre-built dictionary. The trie is skipped if no term starts with the
+    // current character.
+    int numNodes;
+    if (ahoCorasick != nullptr) {
+      numNodes = lexiconMatches.get(current - begin, trieResults.data(),
+                                    maxTrieResults);
+    } else if (!dictionary->mayStartTerm(current, end)) {
+      numNodes = 0;
+    } else if (memoizeTrieResults) {
+      numNodes = trieMemo.search(dictionary, current, end, trieResults.data(),
+                                 maxTrieResults);
+    } else {
+      numNodes = dictionary->commonPrefixSearch(current, end,
+                                                trieResults.data(),
+                                                maxTrieResults);
+    }
     if (numNodes > maxTrieResults)
       return absl::InternalError("Cannot search trie");
 
@@ -274,33 +683,15 @@ absl::Status NoriTokenizer::tokenize(Lattice& lattice,
     auto charDef = dictionary->getCharDef(current, end);
     if ((numNodes == 0) || charDef->invoke() == 1) {
       auto category = dictionary->getCharClass(current, end);
-      int length = internal::groupingUnknownCharacters(
-          current, end, category, dictionary, charDef->group() == 1);
+      if (!unknownWordRuns.isBuilt()) unknownWordRuns.build(inputText);
+      int length = unknownWordRuns.getLength(
+          begin, current - begin, category, dictionary, charDef->group() == 1);
 
       const nori::protos::Morpheme* morpheme =
           &dictionary->getUnkTokens()->morpheme_map().at(category);
-      const int wordCost = morpheme->word_cost();
-      auto spaceCost = internal::getSpacePenalty(morpheme, numSpaces);
-      int connectionCost;
-      auto parent = internal::selectParent(nodesByPos[offset], morpheme,
-                                           this->dictionary, connectionCost);
-
-      auto lastPositionIndex = parent->lastPositionIndex + numSpaces + length;
-      auto lastNodeId = nodeId;
-      auto cost = parent->cost + wordCost + connectionCost + spaceCost;
-
-      nodesByPos[lastPositionIndex].emplace_back(
-          nodeId++, cost, lastPositionIndex, length, morpheme, parent);
-
-      if (visualizer != nullptr) {
-        visualizer->addNode(
-            parent->lastPositionIndex - parent->length, parent->uniqueNodeId,
-            parent->morpheme, parent->lastPositionIndex + numSpaces, lastNodeId,
-            morpheme,
-            std::string(begin + (parent->lastPositionIndex + numSpaces),
-                        begin + lastPositionIndex),
-            wordCost, connectionCost, cost);
-      }
+      internal::addNode(nodesByPos, offset, numSpaces, length, morpheme,
+                        this->dictionary, bestParents, begin, nodeId,
+                        observer);
 
       if (numNodes == 0) {
         offset += numSpaces;
@@ -316,31 +707,9 @@ absl::Status NoriTokenizer::tokenize(Lattice& lattice,
       auto morphemeSize = morphemeList->morphemes_size();
 
       for (int j = 0; j < morphemeSize; j++) {
-        const auto* morpheme = &morphemeList->morphemes(j);
-
-        int wordCost = morpheme->word_cost();
-        int spaceCost = internal::getSpacePenalty(morpheme, numSpaces);
-        int connectionCost;
-        internal::TrieNode* parent = internal::selectParent(
-            nodesByPos[offset], morpheme, this->dictionary, connectionCost);
-
-        int lastPositionIndex =
-            parent->lastPositionIndex + numSpaces + trieResult.length;
-        int lastNodeId = nodeId;
-        int cost = parent->cost + wordCost + connectionCost + spaceCost;
-        nodesByPos[lastPositionIndex].emplace_back(
-            nodeId++, cost, lastPositionIndex, trieResult.length, morpheme,
-            parent);
-
-        if (visualizer != nullptr) {
-          visualizer->addNode(
-              parent->lastPositionIndex - parent->length, parent->uniqueNodeId,
-              parent->morpheme, parent->lastPositionIndex + numSpaces,
-              lastNodeId, morpheme,
-              std::string(begin + (parent->lastPositionIndex + numSpaces),
-                          begin + lastPositionIndex),
-              wordCost, connectionCost, cost);
-        }
+        internal::addNode(nodesByPos, offset, numSpaces, trieResult.length,
+                          &morphemeList->morphemes(j), this->dictionary,
+                          bestParents, begin, nodeId, observer);
       }
     }
 
@@ -349,27 +718,42 @@ absl::Status NoriTokenizer::tokenize(Lattice& lattice,
   }
 
   // Handling EOS node
-  // end of parsing of this path
-  int eosConnectionCost;
-  internal::TrieNode* bestPath =
-      internal::selectParent(nodesByPos.at(offset), bosEosMorpheme,
-                             this->dictionary, eosConnectionCost);
-  if (visualizer != nullptr) {
-    visualizer->addEos(bestPath->lastPositionIndex - bestPath->length,
-                       bestPath->uniqueNodeId, bestPath->morpheme);
+  // end of parsing of this path. A part of a sentence ends with the cheapest
+  // node instead, because the next token is unknown.
+  internal::TrieNode* bestPath;
+  if (leftContext == nullptr) {
+    int eosConnectionCost;
+    bestPath = internal::selectParent(nodesByPos.at(offset), bosEosMorpheme,
+                                      this->dictionary, eosConnectionCost);
+    observer.addEos(bestPath->lastPositionIndex - bestPath->length,
+                    bestPath->uniqueNodeId, bestPath->morpheme);
+  } else {
+    auto& lastNodes = nodesByPos.at(offset);
+    bestPath = &*std::min_element(
+        lastNodes.begin(), lastNodes.end(),
+        [](const internal::TrieNode& a, const internal::TrieNode& b) {
+          return a.cost < b.cost;
+        });
   }
   internal::TrieNode eosNode(0, 0, inputText.length(), 0, bosEosMorpheme,
                              bestPath);
 
   // count node from eos to bos
   int numNode = 0;
-  internal::TrieNode* currentNode = &eosNode;
-  std::vector<internal::TrieNode*> nodes;
+  internal::TrieNode* currentNode =
+      leftContext == nullptr ? &eosNode : bestPath;
+  auto& nodes = scratch.path;
+  nodes.clear();
   while (currentNode != NULL) {
     nodes.push_back(currentNode);
     currentNode = currentNode->parent;
     numNode++;
   }
+  // the node of the left context is not a token of this text
+  if (leftContext != nullptr) {
+    nodes.pop_back();
+    numNode--;
+  }
   std::reverse(nodes.begin(), nodes.end());
 
   // set outputs
@@ -381,19 +765,19 @@ absl::Status NoriTokenizer::tokenize(Lattice& lattice,
     size_t start = node->lastPositionIndex - node->length;
 
     // BOS or EOS
-    if (node->length == 0 && (node->lastPositionIndex == 0 ||
-                              node->lastPositionIndex == inputText.size())) {
+    if (leftContext == nullptr && node->length == 0 &&
+        (node->lastPositionIndex == 0 ||
+         node->lastPositionIndex == inputText.size())) {
       outputTokens->emplace_back(this->dictionary->getBosEosSurface(),
                                  node->morpheme, start, node->length);
     } else {
       outputTokens->emplace_back(inputText.substr(start, node->length),
-                                 node->morpheme, start, node->length);
+                                 node->morpheme, textOffset + start,
+                                 node->length);
     }
   }
 
-  if (visualizer != nullptr) {
-    visualizer->finish();
-  }
+  observer.finish();
 
   return absl::OkStatus();
 }
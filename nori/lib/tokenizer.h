@@ -1,8 +1,11 @@
 #ifndef __NORI_TOKENIZER_H__
 #define __NORI_TOKENIZER_H__
 
+#include <algorithm>
+#include <cstdint>
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "absl/status/status.h"
@@ -13,6 +16,64 @@
 
 namespace nori {
 
+namespace internal {
+
+struct TokenizerScratch;
+
+// Boundaries of unknown words for all positions of a sentence.
+//
+// An unknown word is a run of characters that have the same script (common
+// and inherited characters match any script), the same punctuation and digit
+// properties, and no whitespace. Instead of scanning a run at every position,
+// character properties are computed once and the next position of each kind of
+// boundary is precomputed from right to left, so grouping unknown characters is
+// O(n) over a sentence.
+class UnknownWordRuns {
+ public:
+  // compute boundaries of the sentence
+  void build(absl::string_view sentence);
+
+  // forget the boundaries. Buffers are kept for the next sentence.
+  void clear() { built = false; }
+
+  bool isBuilt() const { return built; }
+
+  // return the length in bytes of the unknown word that starts at `offset`.
+  // If the word starts with a common or inherited character, `category` is
+  // updated to the character class of the last non-punctuation character.
+  int getLength(const char* begin, size_t offset,
+                nori::protos::CharacterClass& category,
+                const nori::dictionary::Dictionary* dictionary,
+                const bool doGroup) const;
+
+ private:
+  static constexpr uint8_t kBreak = 1;
+  static constexpr uint8_t kFailure = 2;
+  static constexpr uint8_t kPunctuation = 4;
+  static constexpr uint8_t kDigit = 8;
+  static constexpr uint8_t kCommon = 16;
+
+  bool built = false;
+
+  // byte offset to the index of the character
+  std::vector<int> indices;
+  // byte offsets of characters, and the length of the sentence
+  std::vector<size_t> offsets;
+  std::vector<uint8_t> flags;
+  std::vector<uint8_t> scripts;
+
+  std::vector<int> nextBreak;
+  std::vector<int> nextPunctuation;
+  std::vector<int> nextNonPunctuation;
+  std::vector<int> nextDigit;
+  std::vector<int> nextNonDigit;
+  std::vector<int> nextNonCommon;
+  std::vector<int> nextOtherScript;
+  std::vector<int> lastNonPunctuation;
+};
+
+}  // namespace internal
+
 // Token output of nori::Lattice
 //
 // surface is absl::string_view type because original input data will be stored
@@ -39,9 +100,18 @@ struct Lattice {
  private:
   std::string sentence;
   std::vector<Token> tokens;
+  // user dictionaries that tokens refer to. They are kept alive while the
+  // user dictionary is reloaded.
+  std::vector<std::shared_ptr<const dictionary::UserDictionary>>
+      userDictionaries;
+  // buffers of the tokenizer. They are kept for the next tokenization.
+  std::unique_ptr<internal::TokenizerScratch> scratch;
 
  public:
-  Lattice() {}
+  Lattice();
+  ~Lattice();
+  Lattice(Lattice&& other) noexcept;
+  Lattice& operator=(Lattice&& other) noexcept;
 
   // clear internal states
   void clear() {
@@ -50,10 +120,14 @@ struct Lattice {
   }
 
   // clear only tokens
-  void clearState() { tokens.clear(); }
+  void clearState() {
+    tokens.clear();
+    userDictionaries.clear();
+  }
 
-  // set sentence
-  absl::Status setSentence(std::string sentence,
+  // set sentence. It is normalized into the buffer of the lattice, so reusing
+  // the lattice doesn't allocate memory once the buffer is large enough.
+  absl::Status setSentence(absl::string_view sentence,
                            const dictionary::Normalizer* normalizer) {
     return normalizer->normalize(sentence, this->sentence);
   }
@@ -68,26 +142,140 @@ struct Lattice {
   // I recommend not to call this method. This method is added for using inside
   // of nori::Tokenizer
   std::vector<Token>* getMutableTokens() { return &this->tokens; }
+
+  // get buffers of the tokenizer. They are created at the first call.
+  // This method is added for using inside of nori::Tokenizer
+  internal::TokenizerScratch* getScratch();
+
+  // keep the user dictionary that new tokens refer to.
+  // This method is added for using inside of nori::Tokenizer
+  void keepUserDictionary(
+      std::shared_ptr<const dictionary::UserDictionary> userDictionary) {
+    if (tokens.empty()) userDictionaries.clear();
+    if (userDictionary == nullptr) return;
+    if (std::find(userDictionaries.begin(), userDictionaries.end(),
+                  userDictionary) == userDictionaries.end())
+      userDictionaries.push_back(std::move(userDictionary));
+  }
+};
+
+// Lattice observer that ignores all events.
+//
+// nori::NoriTokenizer runs the viterbi core with a lattice observer as a
+// template parameter. An observer has to provide the same methods as this
+// struct, and nori::GraphvizVisualizer is one of the observers. Because every
+// method of this struct is empty, the default tokenization path is compiled
+// without any observer overhead.
+struct NoopObserver {
+  // keep nodes that are dominated by a cheaper node with the same end position
+  // and right id. They can't be on the best path, so the tokenizer drops them
+  // unless an observer needs the full lattice, e.g. to find n-best paths.
+  static constexpr bool keepDominatedNodes = false;
+
+  void reset() {}
+
+  void addNode(size_t fromIndex, size_t fromNodeId,
+               const nori::protos::Morpheme* fromMorpheme, size_t toIndex,
+               size_t toNodeId, const nori::protos::Morpheme* toMorpheme,
+               absl::string_view stringForm, int wordCost, int connectionCost,
+               int cost) {}
+
+  void addEos(size_t fromIndex, size_t fromNodeId,
+              const nori::protos::Morpheme* fromMorpheme) {}
+
+  void finish() {}
+};
+
+// Best token sequences of eojeols (whitespace-delimited words) for
+// NoriTokenizer::tokenize with a cache.
+//
+// An eojeol is keyed by its surface, the right id of the previous token and
+// whether whitespaces precede it. All entries are dropped when the cache is
+// full or when the user dictionary is reloaded. This class is not thread-safe,
+// so use one cache per thread.
+class EojeolCache {
+ public:
+  explicit EojeolCache(size_t maxEntries = 100000) : maxEntries(maxEntries) {}
+
+  void clear() { entries.clear(); }
+
+  size_t size() const { return entries.size(); }
+  size_t getNumHits() const { return numHits; }
+  size_t getNumMisses() const { return numMisses; }
+
+ private:
+  friend class NoriTokenizer;
+
+  struct CachedToken {
+    // offset from the start of the eojeol
+    size_t offset;
+    size_t length;
+    const nori::protos::Morpheme* morpheme;
+  };
+
+  const size_t maxEntries;
+  size_t numHits = 0, numMisses = 0;
+  std::unordered_map<std::string, std::vector<CachedToken>> entries;
+  // dictionaries that cached morphemes belong to
+  const nori::dictionary::Dictionary* dictionary = nullptr;
+  std::shared_ptr<const dictionary::UserDictionary> userDictionary;
 };
 
 // Tokenizer class
 class NoriTokenizer {
  public:
+  // If `memoizeTrieResults` is true, trie results are memoized for each
+  // tokenize call, so repeated substrings of long texts like documents skip
+  // the trie. The output is the same.
   NoriTokenizer(const nori::dictionary::Dictionary* dictionary,
-                size_t maxTrieResults = 1024)
-      : dictionary(dictionary), maxTrieResults(maxTrieResults) {}
+                size_t maxTrieResults = 1024, bool memoizeTrieResults = false)
+      : dictionary(dictionary),
+        maxTrieResults(maxTrieResults),
+        memoizeTrieResults(memoizeTrieResults) {}
 
   // Tokenize input text and save tokenized information to lattice
   absl::Status tokenize(Lattice& lattice,
                         GraphvizVisualizer* visualizer = nullptr) const;
 
+  // Tokenize input text with a stack of user dictionary overlays, e.g. global
+  // and tenant user dictionaries. Overlays are stacked on the user dictionary
+  // of the dictionary, and later overlays take precedence over earlier ones.
+  // Overlays can be loaded with Dictionary::loadUserOverlay and shared by many
+  // calls.
+  absl::Status tokenize(
+      Lattice& lattice,
+      const std::vector<std::shared_ptr<const dictionary::UserDictionary>>&
+          overlays,
+      GraphvizVisualizer* visualizer = nullptr) const;
+
+  // Tokenize input text approximately, reusing the best paths of eojeols in
+  // `cache`. Only eojeols that are not in the cache are tokenized, each after
+  // the last token of the previous eojeol and ending with its cheapest node,
+  // so tokens can differ from the exact tokenization at eojeol boundaries.
+  // The output keeps BOS and EOS tokens, and user dictionary overlays are not
+  // supported.
+  absl::Status tokenize(Lattice& lattice, EojeolCache& cache) const;
+
   const nori::dictionary::Dictionary* getDictionary() const {
     return dictionary;
   }
 
  private:
+  // viterbi core specialized by the lattice observer and the existence of the
+  // user dictionary. It appends tokens of `inputText`, a part of the sentence
+  // of `lattice`. The path starts with BOS and ends with EOS, or starts after
+  // a token of `leftContext` if it's not nullptr. Buffers of the core are kept
+  // in the lattice.
+  template <class Observer, bool useUserDictionary>
+  absl::Status tokenize(
+      Lattice& lattice, Observer& observer,
+      const std::vector<const dictionary::UserDictionary*>& userDictionaries,
+      absl::string_view inputText,
+      const nori::protos::Morpheme* leftContext = nullptr) const;
+
   const nori::dictionary::Dictionary* dictionary;
   const size_t maxTrieResults;
+  const bool memoizeTrieResults;
 };
 
 }  // namespace nori
@@ -2,9 +2,19 @@
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
+#include <sys/stat.h>
+
+#include <atomic>
+#include <fstream>
+#include <random>
+#include <thread>
 
 #include "absl/log/check.h"
 #include "absl/log/log.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+#include "absl/strings/str_split.h"
+#include "nori/lib/dictionary/builder.h"
 #include "nori/lib/dictionary/dictionary.h"
 
 nori::dictionary::Dictionary legacyDictionary, dictionary;
@@ -141,6 +151,345 @@ TEST(NoriTokenizer, testLegacyDictionary) {
   }
 }
 
+TEST(NoriTokenizer, testObserver) {
+  const std::string input = "화학 이외의 것";
+
+  nori::NoriTokenizer tokenizer(&dictionary);
+  nori::Lattice lattice, visualizedLattice;
+  ASSERT_TRUE(lattice.setSentence(input, dictionary.getNormalizer()).ok());
+  ASSERT_TRUE(
+      visualizedLattice.setSentence(input, dictionary.getNormalizer()).ok());
+
+  nori::GraphvizVisualizer visualizer;
+  ASSERT_TRUE(tokenizer.tokenize(lattice).ok());
+  ASSERT_TRUE(tokenizer.tokenize(visualizedLattice, &visualizer).ok());
+
+  ASSERT_EQ(lattice.getTokens()->size(), visualizedLattice.getTokens()->size());
+  for (int i = 0; i < lattice.getTokens()->size(); i++) {
+    ASSERT_EQ(lattice.getTokens()->at(i).surface,
+              visualizedLattice.getTokens()->at(i).surface);
+    ASSERT_EQ(lattice.getTokens()->at(i).morpheme,
+              visualizedLattice.getTokens()->at(i).morpheme);
+  }
+  ASSERT_THAT(visualizer.str(), testing::HasSubstr("화학"));
+}
+
+TEST(NoriTokenizer, testReloadUserDictionary) {
+  nori::dictionary::Dictionary userDictionary;
+  ASSERT_TRUE(
+      userDictionary.loadPrebuilt("./dictionary/latest-dictionary.nori").ok());
+  ASSERT_TRUE(userDictionary.loadUser("./dictionary/latest-userdict.txt").ok());
+
+  const std::string input = "세종시 대한민국날씨";
+  nori::NoriTokenizer tokenizer(&userDictionary);
+  nori::Lattice pinnedLattice;
+  ASSERT_TRUE(
+      pinnedLattice.setSentence(input, userDictionary.getNormalizer()).ok());
+  ASSERT_TRUE(tokenizer.tokenize(pinnedLattice).ok());
+  const std::string expected =
+      pinnedLattice.getTokens()->at(1).morpheme->SerializeAsString();
+
+  std::atomic<bool> done(false);
+  std::atomic<int> numFailures(0);
+  std::vector<std::thread> workers;
+  for (int i = 0; i < 4; i++) {
+    workers.emplace_back([&]() {
+      while (!done) {
+        nori::Lattice lattice;
+        if (!lattice.setSentence(input, userDictionary.getNormalizer()).ok() ||
+            !tokenizer.tokenize(lattice).ok())
+          numFailures++;
+      }
+    });
+  }
+  for (int i = 0; i < 20; i++) {
+    ASSERT_TRUE(
+        userDictionary.loadUser("./dictionary/latest-userdict.txt").ok());
+  }
+  done = true;
+  for (auto& worker : workers) worker.join();
+
+  ASSERT_EQ(numFailures, 0);
+  // tokens still refer to the user dictionary used for tokenization.
+  ASSERT_EQ(pinnedLattice.getTokens()->at(1).morpheme->SerializeAsString(),
+            expected);
+}
+
+TEST(NoriTokenizer, testUserDictionaryOverlays) {
+  std::shared_ptr<const nori::dictionary::UserDictionary> global, tenant;
+  ASSERT_TRUE(
+      dictionary.loadUserOverlay("./dictionary/latest-userdict.txt", global)
+          .ok());
+  {
+    std::ofstream ofs("tenant-userdict.txt");
+    ofs << "세종시 세 종시\n";
+  }
+  ASSERT_TRUE(dictionary.loadUserOverlay("tenant-userdict.txt", tenant).ok());
+  ASSERT_FALSE(dictionary.isUserInitialized());
+
+  nori::NoriTokenizer tokenizer(&dictionary);
+  nori::Lattice lattice;
+  ASSERT_TRUE(lattice.setSentence("세종시", dictionary.getNormalizer()).ok());
+
+  ASSERT_TRUE(tokenizer.tokenize(lattice, {global}).ok());
+  ASSERT_EQ(lattice.getTokens()->size(), 3);
+  ASSERT_EQ(lattice.getTokens()->at(1).surface, "세종시");
+  ASSERT_EQ(lattice.getTokens()->at(1).morpheme->expression(0).surface(),
+            "세종");
+
+  // the tenant overlay shadows the global one.
+  lattice.clearState();
+  ASSERT_TRUE(tokenizer.tokenize(lattice, {global, tenant}).ok());
+  ASSERT_EQ(lattice.getTokens()->size(), 3);
+  ASSERT_EQ(lattice.getTokens()->at(1).surface, "세종시");
+  ASSERT_EQ(lattice.getTokens()->at(1).morpheme->expression(0).surface(),
+            "세");
+}
+
+TEST(NoriTokenizer, testEojeolCache) {
+  const std::string input = "화학 이외의 것 화학  이외의";
+
+  nori::NoriTokenizer tokenizer(&dictionary);
+  nori::EojeolCache cache;
+  nori::Lattice lattice, cachedLattice;
+  ASSERT_TRUE(lattice.setSentence(input, dictionary.getNormalizer()).ok());
+  ASSERT_TRUE(
+      cachedLattice.setSentence(input, dictionary.getNormalizer()).ok());
+  ASSERT_TRUE(tokenizer.tokenize(lattice, cache).ok());
+  ASSERT_EQ(cache.size(), 4);
+  ASSERT_EQ(cache.getNumHits(), 1);
+
+  // the second sentence reuses all eojeols.
+  ASSERT_TRUE(tokenizer.tokenize(cachedLattice, cache).ok());
+  ASSERT_EQ(cache.getNumHits(), 6);
+  ASSERT_EQ(cache.getNumMisses(), 4);
+
+  const auto& tokens = *lattice.getTokens();
+  const auto& cachedTokens = *cachedLattice.getTokens();
+  ASSERT_EQ(tokens.size(), cachedTokens.size());
+  ASSERT_EQ(tokens.front().morpheme, dictionary.getBosEosMorpheme());
+  ASSERT_EQ(tokens.back().morpheme, dictionary.getBosEosMorpheme());
+  ASSERT_EQ(tokens.back().offset, input.size());
+  for (int i = 0; i < tokens.size(); i++) {
+    ASSERT_EQ(tokens[i].morpheme, cachedTokens[i].morpheme);
+    ASSERT_EQ(tokens[i].offset, cachedTokens[i].offset);
+    ASSERT_EQ(cachedTokens[i].surface, tokens[i].surface);
+    if (i > 0 && i + 1 < tokens.size()) {
+      ASSERT_EQ(tokens[i].surface,
+                cachedLattice.getSentence().substr(tokens[i].offset,
+                                                   tokens[i].length));
+    }
+  }
+}
+
+TEST(NoriTokenizer, testEojeolCacheKeys) {
+  nori::NoriTokenizer tokenizer(&dictionary);
+  nori::EojeolCache cache;
+  const auto tokenize = [&](const std::string& input) {
+    nori::Lattice lattice;
+    CHECK(lattice.setSentence(input, dictionary.getNormalizer()).ok());
+    CHECK(tokenizer.tokenize(lattice, cache).ok());
+    return lattice;
+  };
+
+  // the same eojeol after tokens with different right ids is another key.
+  tokenize("화학 것");
+  ASSERT_EQ(cache.getNumMisses(), 2);
+  tokenize("이외의 것");
+  ASSERT_EQ(cache.getNumHits(), 0);
+  ASSERT_EQ(cache.getNumMisses(), 4);
+  ASSERT_EQ(cache.size(), 4);
+
+  // the same right id and the same leading whitespaces hit.
+  tokenize("화학 것");
+  ASSERT_EQ(cache.getNumHits(), 2);
+  ASSERT_EQ(cache.getNumMisses(), 4);
+  tokenize("화학  것");
+  ASSERT_EQ(cache.getNumHits(), 4);
+  ASSERT_EQ(cache.getNumMisses(), 4);
+
+  // eojeols with a single path, e.g. grouped unknown words, are tokenized like
+  // the exact tokenization.
+  for (const std::string input : {"xqz wvk", "xqz  wvk jkq", "wvk xqz"}) {
+    const auto cached = tokenize(input);
+    nori::Lattice lattice;
+    ASSERT_TRUE(lattice.setSentence(input, dictionary.getNormalizer()).ok());
+    ASSERT_TRUE(tokenizer.tokenize(lattice).ok());
+
+    const auto& tokens = *lattice.getTokens();
+    const auto& cachedTokens = *cached.getTokens();
+    ASSERT_EQ(tokens.size(), cachedTokens.size()) << input;
+    for (int i = 0; i < tokens.size(); i++) {
+      ASSERT_EQ(tokens[i].morpheme, cachedTokens[i].morpheme) << input;
+      ASSERT_EQ(tokens[i].offset, cachedTokens[i].offset) << input;
+      ASSERT_EQ(tokens[i].length, cachedTokens[i].length) << input;
+    }
+  }
+}
+
+TEST(NoriTokenizer, testUnknownWordRuns) {
+  using nori::protos::CharacterClass;
+
+  // length of the run at `offset`, and the category that it updates.
+  const auto getRun = [](const std::string& input, size_t offset,
+                         bool doGroup = true) {
+    nori::internal::UnknownWordRuns runs;
+    runs.build(input);
+    CharacterClass category = CharacterClass::NGRAM;
+    const int length =
+        runs.getLength(input.data(), offset, category, &dictionary, doGroup);
+    return std::make_pair(length, category);
+  };
+
+  // scripts: Latin, Cyrillic and Hangul
+  const std::string scripts = "abcабв가나 def";
+  ASSERT_EQ(getRun(scripts, 0).first, 3);
+  ASSERT_EQ(getRun(scripts, 1).first, 2);
+  ASSERT_EQ(getRun(scripts, 3).first, 6);
+  ASSERT_EQ(getRun(scripts, 9).first, 6);
+  ASSERT_EQ(getRun(scripts, 16).first, 3);
+  ASSERT_EQ(getRun(scripts, 0, false).first, 1);
+  ASSERT_EQ(getRun(scripts, 9, false).first, 3);
+
+  // digits next to punctuation
+  const std::string digits = "12,345...6a";
+  ASSERT_EQ(getRun(digits, 0).first, 2);
+  ASSERT_EQ(getRun(digits, 2).first, 1);
+  ASSERT_EQ(getRun(digits, 3).first, 3);
+  ASSERT_EQ(getRun(digits, 6).first, 3);
+  ASSERT_EQ(getRun(digits, 9).first, 1);
+  ASSERT_EQ(getRun(digits, 10).first, 1);
+
+  // inherited characters (U+0301) match the script of the run.
+  const std::string inherited = "ab\u0301cб";
+  ASSERT_EQ(getRun(inherited, 0).first, 5);
+  ASSERT_EQ(getRun(inherited, 0).second, CharacterClass::NGRAM);
+
+  // runs that start with a common character (U+30FC) take any script, and
+  // their category is the one of the last non-punctuation character.
+  const std::string common = "ーabcαβ..";
+  auto run = getRun(common, 0);
+  ASSERT_EQ(run.first, 10);
+  ASSERT_EQ(run.second, dictionary.getCharClass(common.data() + 8,
+                                                common.data() + common.size()));
+  ASSERT_EQ(run.second, CharacterClass::GREEK);
+  run = getRun(common, 10);
+  ASSERT_EQ(run.first, 2);
+  ASSERT_EQ(run.second, CharacterClass::NGRAM);
+
+  // a long run is grouped as a whole from every offset.
+  const std::string longRun = std::string(10000, 'a') + " b";
+  ASSERT_EQ(getRun(longRun, 0).first, 10000);
+  ASSERT_EQ(getRun(longRun, 5000).first, 5000);
+  ASSERT_EQ(getRun(longRun, 10001).first, 1);
+}
+
+TEST(NoriTokenizer, testMemoizeTrieResults) {
+  std::string document;
+  for (int i = 0; i < 10; i++) document += "화학 이외의 것. 세종시 화학 ";
+
+  nori::NoriTokenizer tokenizer(&dictionary);
+  nori::NoriTokenizer memoizingTokenizer(&dictionary, 1024, true);
+  nori::Lattice lattice, memoizedLattice;
+  ASSERT_TRUE(lattice.setSentence(document, dictionary.getNormalizer()).ok());
+  ASSERT_TRUE(
+      memoizedLattice.setSentence(document, dictionary.getNormalizer()).ok());
+  ASSERT_TRUE(tokenizer.tokenize(lattice).ok());
+  ASSERT_TRUE(memoizingTokenizer.tokenize(memoizedLattice).ok());
+
+  const auto& tokens = *lattice.getTokens();
+  const auto& memoizedTokens = *memoizedLattice.getTokens();
+  ASSERT_EQ(tokens.size(), memoizedTokens.size());
+  for (int i = 0; i < tokens.size(); i++) {
+    ASSERT_EQ(tokens[i].offset, memoizedTokens[i].offset);
+    ASSERT_EQ(tokens[i].length, memoizedTokens[i].length);
+    ASSERT_EQ(tokens[i].morpheme, memoizedTokens[i].morpheme);
+  }
+}
+
+TEST(NoriTokenizer, testLexiconEncodings) {
+  using nori::dictionary::builder::DictionaryBuilder;
+  using nori::protos::KeyEncoding;
+
+  // testdata with unknown tokens that fit its connection costs. Ids of the
+  // unknown tokens of testdata are the ones of mecab-ko-dic.
+  const std::string directory = "./lexicon-testdata/";
+  mkdir(directory.c_str(), 0755);
+  for (const std::string filename :
+       {"char.def", "unk.def", "matrix.def", "left-id.def", "right-id.def",
+        "test.csv"}) {
+    std::ifstream ifs("./testdata/dictionaryBuilder/" + filename);
+    std::ofstream ofs(directory + filename);
+    ASSERT_TRUE(ifs.is_open() && ofs.is_open()) << filename;
+    for (std::string line; std::getline(ifs, line);) {
+      if (filename == "unk.def") {
+        std::vector<std::string> fields = absl::StrSplit(line, ',');
+        fields[1] = "1";
+        fields[2] = "1";
+        line = absl::StrJoin(fields, ",");
+      }
+      ofs << line << "\n";
+    }
+  }
+
+  // the same sources with the trie, the Aho-Corasick automaton and compact
+  // keys. The first one is the plain dictionary.
+  const std::vector<std::pair<KeyEncoding, bool>> options = {
+      {KeyEncoding::UTF8, false},
+      {KeyEncoding::UTF8, true},
+      {KeyEncoding::HANGUL_COMPACT, false},
+      {KeyEncoding::HANGUL_COMPACT, true},
+  };
+  std::vector<nori::dictionary::Dictionary> dictionaries(options.size());
+  for (int i = 0; i < options.size(); i++) {
+    DictionaryBuilder builder(true, "NFKC", 0, options[i].first,
+                              options[i].second);
+    auto status = builder.build(directory);
+    ASSERT_TRUE(status.ok()) << status.message();
+    const std::string filename = absl::StrCat("encoding-", i, ".nori");
+    status = builder.save(filename);
+    ASSERT_TRUE(status.ok()) << status.message();
+    status = dictionaries[i].loadPrebuilt(filename);
+    ASSERT_TRUE(status.ok()) << status.message();
+  }
+  ASSERT_EQ(dictionaries[0].getAhoCorasick(), nullptr);
+  ASSERT_NE(dictionaries[1].getAhoCorasick(), nullptr);
+
+  // random sentences of terms that share prefixes, parts of terms and unknown
+  // words
+  const std::vector<std::string> pieces = {
+      "ㄴ다든가", "ㄴ다든", "ㄴ다던가", "ㄴ다고", "ㄴ강", "ㄴ", "다", "든가",
+      "고요",     " ",      "  ",       "a",      "12",   ".",  "αβ"};
+  std::mt19937 random(1234);
+  for (int n = 0; n < 1000; n++) {
+    std::string input;
+    const int numPieces = random() % 12 + 1;
+    for (int i = 0; i < numPieces; i++)
+      input += pieces[random() % pieces.size()];
+
+    std::vector<nori::Lattice> lattices(dictionaries.size());
+    for (int i = 0; i < dictionaries.size(); i++) {
+      nori::NoriTokenizer tokenizer(&dictionaries[i]);
+      ASSERT_TRUE(
+          lattices[i].setSentence(input, dictionaries[i].getNormalizer()).ok());
+      ASSERT_TRUE(tokenizer.tokenize(lattices[i]).ok()) << input;
+    }
+
+    const auto& tokens = *lattices[0].getTokens();
+    for (int i = 1; i < dictionaries.size(); i++) {
+      const auto& otherTokens = *lattices[i].getTokens();
+      ASSERT_EQ(tokens.size(), otherTokens.size()) << i << ": " << input;
+      for (int j = 0; j < tokens.size(); j++) {
+        ASSERT_EQ(tokens[j].offset, otherTokens[j].offset) << input;
+        ASSERT_EQ(tokens[j].length, otherTokens[j].length) << input;
+        ASSERT_EQ(tokens[j].morpheme->SerializeAsString(),
+                  otherTokens[j].morpheme->SerializeAsString())
+            << input;
+      }
+    }
+  }
+}
+
 int main(int argc, char* argv[]) {
   ::testing::InitGoogleTest(&argc, argv);
 
@@ -0,0 +1,77 @@
+#ifndef __NORI_UNICODE_PROPERTIES_H__
+#define __NORI_UNICODE_PROPERTIES_H__
+
+#include <cstdint>
+
+namespace nori {
+namespace unicode {
+
+// Character properties used to group unknown characters, packed into 16 bits.
+//
+// The low 8 bits are ICU's UScriptCode of the character, and the other bits
+// are flags. Properties are looked up in a two-level table generated from ICU
+// at build time (see unicode_properties_generator.cc), so the tokenizer does
+// not call ICU per character.
+constexpr uint16_t kScriptMask = 0xFF;
+constexpr uint16_t kPunctuation = 1 << 8;
+constexpr uint16_t kDigit = 1 << 9;
+constexpr uint16_t kWhiteSpace = 1 << 10;
+// set for values that are not code points. Their script is kInvalidScript.
+constexpr uint16_t kInvalid = 1 << 11;
+
+constexpr uint8_t kScriptCommon = 0;     // USCRIPT_COMMON
+constexpr uint8_t kScriptInherited = 1;  // USCRIPT_INHERITED
+constexpr uint8_t kInvalidScript = 0xFF;
+
+constexpr int32_t kMaxCodePoint = 0x10FFFF;
+
+namespace internal {
+
+// Code points are split into blocks of 2^kBlockShift code points, and blocks
+// with the same properties are stored once.
+constexpr int kBlockShift = 7;
+constexpr int kBlockSize = 1 << kBlockShift;
+constexpr int kNumBlockIndices = (kMaxCodePoint >> kBlockShift) + 1;
+
+// index of the block for each block of code points
+extern const uint16_t kBlockIndices[kNumBlockIndices];
+// properties of all unique blocks
+extern const uint16_t kBlocks[];
+
+}  // namespace internal
+
+// return properties of the code point.
+inline uint16_t getProperties(int32_t c) {
+  if (static_cast<uint32_t>(c) > static_cast<uint32_t>(kMaxCodePoint))
+    return kInvalid | kInvalidScript;
+
+  const uint32_t block = internal::kBlockIndices[c >> internal::kBlockShift];
+  return internal::kBlocks[(block << internal::kBlockShift) |
+                           (c & (internal::kBlockSize - 1))];
+}
+
+inline uint8_t getScript(uint16_t properties) {
+  return properties & kScriptMask;
+}
+
+inline bool isCommonOrInherited(uint16_t properties) {
+  const uint8_t script = getScript(properties);
+  return script == kScriptCommon || script == kScriptInherited;
+}
+
+inline bool isPunctuation(uint16_t properties) {
+  return properties & kPunctuation;
+}
+
+inline bool isDigit(uint16_t properties) { return properties & kDigit; }
+
+inline bool isWhiteSpace(uint16_t properties) {
+  return properties & kWhiteSpace;
+}
+
+inline bool isInvalid(uint16_t properties) { return properties & kInvalid; }
+
+}  // namespace unicode
+}  // namespace nori
+
+#endif  // __NORI_UNICODE_PROPERTIES_H__
@@ -0,0 +1,122 @@
+// Generate the property tables of nori/lib/unicode_properties.h from ICU.
+//
+// Usage: unicode_properties_generator <output.cc>
+
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <vector>
+
+#include "icu4c/source/common/unicode/uchar.h"
+#include "icu4c/source/common/unicode/uscript.h"
+#include "nori/lib/unicode_properties.h"
+
+namespace {
+
+bool isPunctuation(UChar32 ch) {
+  if (ch == 4510) {  // Hangul Letter Araea
+    return true;
+  }
+
+  switch (u_charType(ch)) {
+    case UCharCategory::U_SPACE_SEPARATOR:
+    case UCharCategory::U_LINE_SEPARATOR:
+    case UCharCategory::U_PARAGRAPH_SEPARATOR:
+    case UCharCategory::U_CONTROL_CHAR:
+    case UCharCategory::U_FORMAT_CHAR:
+    case UCharCategory::U_DASH_PUNCTUATION:
+    case UCharCategory::U_START_PUNCTUATION:
+    case UCharCategory::U_END_PUNCTUATION:
+    case UCharCategory::U_CONNECTOR_PUNCTUATION:
+    case UCharCategory::U_OTHER_PUNCTUATION:
+    case UCharCategory::U_MATH_SYMBOL:
+    case UCharCategory::U_CURRENCY_SYMBOL:
+    case UCharCategory::U_MODIFIER_SYMBOL:
+    case UCharCategory::U_OTHER_SYMBOL:
+    case UCharCategory::U_INITIAL_PUNCTUATION:
+    case UCharCategory::U_FINAL_PUNCTUATION:
+      return true;
+  }
+  return false;
+}
+
+bool getProperties(UChar32 c, uint16_t& properties) {
+  UErrorCode err = U_ZERO_ERROR;
+  auto script = uscript_getScript(c, &err);
+  if (U_FAILURE(err) || script < 0 || script >= nori::unicode::kInvalidScript) {
+    std::cerr << "Cannot pack the script " << script << " of U+" << std::hex
+              << c << std::endl;
+    return false;
+  }
+
+  properties = script;
+  if (isPunctuation(c)) properties |= nori::unicode::kPunctuation;
+  if (u_isdigit(c)) properties |= nori::unicode::kDigit;
+  if (u_hasBinaryProperty(c, UCHAR_WHITE_SPACE))
+    properties |= nori::unicode::kWhiteSpace;
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  using nori::unicode::internal::kBlockSize;
+  using nori::unicode::internal::kNumBlockIndices;
+
+  if (argc != 2) {
+    std::cerr << "Usage: " << argv[0] << " <output.cc>" << std::endl;
+    return 1;
+  }
+
+  std::vector<uint16_t> blockIndices;
+  std::vector<std::vector<uint16_t>> blocks;
+  std::map<std::vector<uint16_t>, uint16_t> blockMap;
+
+  std::vector<uint16_t> block(kBlockSize);
+  for (int i = 0; i < kNumBlockIndices; i++) {
+    for (int j = 0; j < kBlockSize; j++) {
+      if (!getProperties(i * kBlockSize + j, block[j])) return 1;
+    }
+
+    auto it = blockMap.find(block);
+    if (it == blockMap.end()) {
+      it = blockMap.emplace(block, blocks.size()).first;
+      blocks.push_back(block);
+    }
+    blockIndices.push_back(it->second);
+  }
+
+  std::ofstream ofs(argv[1]);
+  if (ofs.fail()) {
+    std::cerr << "Cannot open " << argv[1] << std::endl;
+    return 1;
+  }
+
+  ofs << "// Generated by unicode_properties_generator with ICU "
+      << U_ICU_VERSION << ". Do not edit.\n\n"
+      << "#include \"nori/lib/unicode_properties.h\"\n\n"
+      << "namespace nori {\nnamespace unicode {\nnamespace internal {\n\n";
+
+  ofs << "const uint16_t kBlockIndices[kNumBlockIndices] = {";
+  for (int i = 0; i < blockIndices.size(); i++) {
+    ofs << (i % 16 == 0 ? "\n    " : " ") << blockIndices[i] << ",";
+  }
+  ofs << "\n};\n\n";
+
+  ofs << "const uint16_t kBlocks[] = {";
+  for (const auto& block : blocks) {
+    for (int i = 0; i < block.size(); i++) {
+      ofs << (i % 16 == 0 ? "\n    " : " ") << block[i] << ",";
+    }
+  }
+  ofs << "\n};\n\n"
+      << "}  // namespace internal\n}  // namespace unicode\n}  // namespace "
+         "nori\n";
+
+  ofs.close();
+  if (ofs.fail()) {
+    std::cerr << "Cannot write " << argv[1] << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,49 @@
+#include "nori/lib/unicode_properties.h"
+
+#include <gtest/gtest.h>
+
+#include "icu4c/source/common/unicode/uchar.h"
+#include "icu4c/source/common/unicode/uscript.h"
+
+using namespace nori::unicode;
+
+TEST(TestUnicodeProperties, matchICU) {
+  const uint32_t punctuationMask =
+      U_GC_ZS_MASK | U_GC_ZL_MASK | U_GC_ZP_MASK | U_GC_CC_MASK |
+      U_GC_CF_MASK | U_GC_PD_MASK | U_GC_PS_MASK | U_GC_PE_MASK |
+      U_GC_PC_MASK | U_GC_PO_MASK | U_GC_SM_MASK | U_GC_SC_MASK |
+      U_GC_SK_MASK | U_GC_SO_MASK | U_GC_PI_MASK | U_GC_PF_MASK;
+
+  for (UChar32 c = 0; c <= kMaxCodePoint; c++) {
+    const uint16_t properties = getProperties(c);
+
+    UErrorCode err = U_ZERO_ERROR;
+    const auto script = uscript_getScript(c, &err);
+    ASSERT_TRUE(U_SUCCESS(err));
+    ASSERT_EQ(getScript(properties), script) << "U+" << std::hex << c;
+    ASSERT_EQ(isCommonOrInherited(properties),
+              script == USCRIPT_COMMON || script == USCRIPT_INHERITED)
+        << "U+" << std::hex << c;
+    ASSERT_EQ(isPunctuation(properties),
+              c == 4510 || (U_GET_GC_MASK(c) & punctuationMask) != 0)
+        << "U+" << std::hex << c;
+    ASSERT_EQ(isDigit(properties), static_cast<bool>(u_isdigit(c)))
+        << "U+" << std::hex << c;
+    ASSERT_EQ(isWhiteSpace(properties),
+              static_cast<bool>(u_hasBinaryProperty(c, UCHAR_WHITE_SPACE)))
+        << "U+" << std::hex << c;
+    ASSERT_FALSE(isInvalid(properties)) << "U+" << std::hex << c;
+  }
+}
+
+TEST(TestUnicodeProperties, invalidCodePoints) {
+  for (int32_t c : {-1, kMaxCodePoint + 1, 0x1FFFFF}) {
+    const uint16_t properties = getProperties(c);
+    ASSERT_TRUE(isInvalid(properties));
+    ASSERT_EQ(getScript(properties), kInvalidScript);
+    ASSERT_FALSE(isCommonOrInherited(properties));
+    ASSERT_FALSE(isPunctuation(properties));
+    ASSERT_FALSE(isDigit(properties));
+    ASSERT_FALSE(isWhiteSpace(properties));
+  }
+}
@@ -1,8 +1,11 @@
 #include "nori/lib/utils.h"
 
 #include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <unistd.h>
 
 #include "absl/log/check.h"
 #include "absl/log/log.h"
@@ -36,7 +39,7 @@ LastCharType::LastCharType detectLastCharacterType(absl::string_view input) {
   return LastCharType::NNG_F;
 }
 
-absl::Status normalizeUTF8(const std::string input, std::string& output,
+absl::Status normalizeUTF8(absl::string_view input, std::string& output,
                            absl::string_view normalizationForm) {
   icu::ErrorCode icuError;
   const icu::Normalizer2* normalizer;
@@ -54,7 +57,7 @@ absl::Status normalizeUTF8(const std::string input, std::string& output,
                      normalizationForm, " Instance."));
 
   icu::StringByteSink<std::string> byte_sink(&output);
-  normalizer->normalizeUTF8(0, icu::StringPiece(input.c_str(), input.size()),
+  normalizer->normalizeUTF8(0, icu::StringPiece(input.data(), input.size()),
                             byte_sink, nullptr, icuError);
 
   if (!icuError.isSuccess())
@@ -91,19 +94,27 @@ std::string joinPath(absl::string_view directory, absl::string_view filename) {
 }
 
 void parseCSVLine(std::string line, std::vector<std::string>& entries) {
+  std::vector<absl::string_view> views;
+  parseCSVLine(absl::string_view(line), views);
+
+  entries.reserve(entries.size() + views.size());
+  for (const auto& view : views) entries.emplace_back(view);
+}
+
+void parseCSVLine(absl::string_view line,
+                  std::vector<absl::string_view>& entries) {
   bool insideQuote = false;
   int start = 0;
 
   for (int index = 0; index < line.length(); index++) {
-    char c = line.at(index);
+    char c = line[index];
 
     if (c == '"') {
       insideQuote = !insideQuote;
     } else if (c == ',' && !insideQuote) {
       int length = index - start, offset = 0;
       while (offset < (index - start) / 2 &&
-             (line.at(start + offset) == '"' &&
-              line.at(index - offset - 1) == '"')) {
+             (line[start + offset] == '"' && line[index - offset - 1] == '"')) {
         length -= 2;
         start += 1;
         offset++;
@@ -146,6 +157,40 @@ int simpleHexAtoi(absl::string_view input) {
   return output;
 }
 
+MappedFile::~MappedFile() {
+  if (data != nullptr) munmap(const_cast<char*>(data), size);
+}
+
+absl::Status MappedFile::open(const std::string& path) {
+  if (data != nullptr) munmap(const_cast<char*>(data), size);
+  data = nullptr;
+  size = 0;
+
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd == -1)
+    return absl::InvalidArgumentError(absl::StrCat("Cannot open file ", path));
+
+  struct stat s;
+  if (fstat(fd, &s) != 0) {
+    close(fd);
+    return absl::InternalError(absl::StrCat("Cannot stat file ", path));
+  }
+
+  size = s.st_size;
+  if (size != 0) {
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped == MAP_FAILED) {
+      close(fd);
+      size = 0;
+      return absl::InternalError(absl::StrCat("Cannot map file ", path));
+    }
+    data = static_cast<const char*>(mapped);
+  }
+
+  close(fd);
+  return absl::OkStatus();
+}
+
 }  // namespace internal
 
 nori::protos::POSType resolvePOSType(absl::string_view name) {
@@ -25,7 +25,7 @@ enum LastCharType {
 LastCharType::LastCharType detectLastCharacterType(absl::string_view input);
 
 // normalize utf8 string
-absl::Status normalizeUTF8(const std::string input, std::string& output,
+absl::Status normalizeUTF8(absl::string_view input, std::string& output,
                            absl::string_view normalizationForm = "NFKC");
 
 // list all files in the directory. This function returns paths as sorted order.
@@ -43,6 +43,11 @@ std::string joinPath(absl::string_view directory, absl::string_view filename);
 // Parse csv from raw string `line` and put outputs into `entries`.
 void parseCSVLine(std::string line, std::vector<std::string>& entries);
 
+// Parse csv from `line` without copying. All views in `entries` point to the
+// memory of `line`.
+void parseCSVLine(absl::string_view line,
+                  std::vector<absl::string_view>& entries);
+
 // Parse csv rows
 std::vector<std::string> parseCSVLine(std::string line);
 
@@ -55,6 +60,25 @@ int simpleAtoi(absl::string_view input);
 // wrapping absl::SimpleHexAtoi
 int simpleHexAtoi(absl::string_view input);
 
+// Read-only memory mapped file.
+class MappedFile {
+ public:
+  MappedFile() : data(nullptr), size(0) {}
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  ~MappedFile();
+
+  // map whole contents of the file. The previous mapping is released.
+  absl::Status open(const std::string& path);
+
+  const char* getData() const { return data; }
+  size_t getSize() const { return size; }
+
+ private:
+  const char* data;
+  size_t size;
+};
+
 }  // namespace internal
 
 // resolve string pos type to proto's enum value
@@ -82,6 +82,13 @@ TEST(TestUtils, parseCSVLine) {
 
   ASSERT_THAT(rows, testing::ElementsAre("ALPHA", "1793", "3533", "795", "SL",
                                          "*", "*", "*", "*", "*", "*", "*"));
+
+  std::vector<absl::string_view> views;
+  internal::parseCSVLine(absl::string_view(inputString), views);
+
+  ASSERT_THAT(views, testing::ElementsAre("ALPHA", "1793", "3533", "795", "SL",
+                                          "*", "*", "*", "*", "*", "*", "*"));
+  ASSERT_EQ(views[0].data(), inputString.data() + 1);
 }
 
 TEST(TestUtils, trimWhitespaces) {
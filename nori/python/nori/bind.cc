@@ -2,39 +2,58 @@
 #include <pybind11/stl.h>
 
 #include <algorithm>
+#include <atomic>
 #include <exception>
+#include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_join.h"
 #include "nori/lib/dictionary/dictionary.h"
+#include "nori/lib/dictionary/registry.h"
 #include "nori/lib/tokenizer.h"
 
 namespace py = pybind11;
 
+// dictionaries that morphemes of tokens point to. The user dictionary is an
+// overlay of the shared dictionary, and it is nullptr if it is not loaded.
+struct PyDictionaries {
+  std::shared_ptr<const nori::dictionary::Dictionary> dictionary;
+  std::shared_ptr<const nori::dictionary::UserDictionary> userDictionary;
+};
+
 struct PyToken {
   const std::string surface;
   const nori::protos::Morpheme *morpheme;
   const size_t offset;
   const size_t length;
+  // keeps `morpheme` alive after the tokenizer loads other dictionaries
+  const std::shared_ptr<const PyDictionaries> dictionaries;
 
   PyToken(const std::string surface, const nori::protos::Morpheme *morpheme,
-          const size_t offset, const size_t length)
-      : surface(surface), morpheme(morpheme), offset(offset), length(length) {}
+          const size_t offset, const size_t length,
+          std::shared_ptr<const PyDictionaries> dictionaries)
+      : surface(surface),
+        morpheme(morpheme),
+        offset(offset),
+        length(length),
+        dictionaries(std::move(dictionaries)) {}
 };
 
 struct PyLattice {
   std::vector<PyToken> tokens;
   std::string sentence;
 
-  PyLattice(const nori::Lattice &lattice) {
+  PyLattice(const nori::Lattice &lattice,
+            const std::shared_ptr<const PyDictionaries> &dictionaries) {
     this->sentence = lattice.getSentence();
     this->tokens.reserve(lattice.getTokens()->size());
     for (const auto &token : *lattice.getTokens()) {
       this->tokens.emplace_back(
           std::string(token.surface.data(), token.surface.length()),
-          token.morpheme, token.offset, token.length);
+          token.morpheme, token.offset, token.length, dictionaries);
     }
   }
 };
@@ -66,49 +85,130 @@ std::vector<std::string> getPostags(
   return results;
 }
 
+// tokenize the sentence. It doesn't touch Python objects, so it can be called
+// without the GIL.
+PyLattice tokenizeSentence(
+    const nori::NoriTokenizer &tokenizer,
+    const std::shared_ptr<const PyDictionaries> &dictionaries,
+    const std::string &sentence) {
+  nori::Lattice lattice;
+  auto status = lattice.setSentence(
+      sentence, tokenizer.getDictionary()->getNormalizer());
+
+  if (!status.ok()) {
+    throw std::runtime_error(
+        absl::StrCat("Cannot normalize string ", sentence));
+  }
+
+  if (dictionaries->userDictionary != nullptr)
+    status = tokenizer.tokenize(lattice, {dictionaries->userDictionary});
+  else
+    status = tokenizer.tokenize(lattice);
+  if (!status.ok()) {
+    throw std::runtime_error(absl::StrCat("Cannot tokenize string ", sentence));
+  }
+
+  return PyLattice(lattice, dictionaries);
+}
+
+// Dictionaries are acquired from the registry, so tokenizers with the same
+// dictionary path share a dictionary. User dictionaries are loaded as overlays
+// of the shared dictionary.
+//
+// The GIL is released while tokenizing, so Python threads can tokenize at the
+// same time. Result objects are built after the GIL is reacquired.
 class PyNoriTokenizer {
  public:
-  PyNoriTokenizer() : tokenizer_(&dictionary_) {}
-
   void load_prebuilt_dictionary(const std::string &path) {
-    auto status = dictionary_.loadPrebuilt(path);
+    auto dictionaries = std::make_shared<PyDictionaries>();
+    auto status = nori::dictionary::DictionaryRegistry::global().acquire(
+        path, "", dictionaries->dictionary);
     if (!status.ok()) {
       throw std::runtime_error("cannot load dictionary");
     }
+
+    tokenizer_ = std::make_shared<nori::NoriTokenizer>(
+        dictionaries->dictionary.get());
+    dictionaries_ = std::move(dictionaries);
   }
 
   void load_user_dictionary(const std::string &path) {
-    auto status = dictionary_.loadUser(path);
+    if (dictionaries_ == nullptr) {
+      throw std::runtime_error("dictionary is not initialized");
+    }
+
+    auto dictionaries = std::make_shared<PyDictionaries>();
+    dictionaries->dictionary = dictionaries_->dictionary;
+    auto status = dictionaries->dictionary->loadUserOverlay(
+        path, dictionaries->userDictionary);
     if (!status.ok()) {
-      throw std::runtime_error("cannot load dictionary");
+      throw std::runtime_error("cannot load user dictionary");
     }
+    dictionaries_ = std::move(dictionaries);
   }
 
   PyLattice tokenize(const std::string sentence) {
-    if (!dictionary_.isInitialized()) {
+    if (dictionaries_ == nullptr) {
       throw std::runtime_error("dictionary is not initialized");
     }
 
-    nori::Lattice lattice;
-    auto status = lattice.setSentence(sentence, dictionary_.getNormalizer());
+    // keep the tokenizer and its dictionaries while other threads load
+    // dictionaries.
+    const auto tokenizer = tokenizer_;
+    const auto dictionaries = dictionaries_;
+    py::gil_scoped_release release;
+    return tokenizeSentence(*tokenizer, dictionaries, sentence);
+  }
 
-    if (!status.ok()) {
-      throw std::runtime_error(
-          absl::StrCat("Cannot normalize string ", sentence));
+  // tokenize sentences on `num_threads` threads. If num_threads is 0, all
+  // available cores are used. If any sentence fails, the error of the first
+  // one is raised.
+  std::vector<PyLattice> tokenize_batch(
+      const std::vector<std::string> &sentences, int num_threads) {
+    if (dictionaries_ == nullptr) {
+      throw std::runtime_error("dictionary is not initialized");
     }
 
-    status = tokenizer_.tokenize(lattice);
-    if (!status.ok()) {
-      throw std::runtime_error(
-          absl::StrCat("Cannot tokenize string ", sentence));
-    }
+    const auto tokenizer = tokenizer_;
+    const auto dictionaries = dictionaries_;
+    py::gil_scoped_release release;
+
+    if (num_threads <= 0)
+      num_threads =
+          std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    const int numWorkers =
+        std::max<int>(1, std::min<size_t>(num_threads, sentences.size()));
+    std::vector<std::unique_ptr<PyLattice>> lattices(sentences.size());
+    std::vector<std::exception_ptr> errors(sentences.size());
 
-    return PyLattice(lattice);
+    std::atomic<size_t> next(0);
+    const auto worker = [&]() {
+      for (size_t i; (i = next.fetch_add(1)) < sentences.size();) {
+        try {
+          lattices[i] = std::make_unique<PyLattice>(
+              tokenizeSentence(*tokenizer, dictionaries, sentences[i]));
+        } catch (...) {
+          errors[i] = std::current_exception();
+        }
+      }
+    };
+    std::vector<std::thread> workers;
+    for (int i = 1; i < numWorkers; i++) workers.emplace_back(worker);
+    worker();
+    for (auto &thread : workers) thread.join();
+
+    std::vector<PyLattice> output;
+    output.reserve(sentences.size());
+    for (size_t i = 0; i < sentences.size(); i++) {
+      if (errors[i]) std::rethrow_exception(errors[i]);
+      output.push_back(std::move(*lattices[i]));
+    }
+    return output;
   }
 
  private:
-  nori::NoriTokenizer tokenizer_;
-  nori::dictionary::Dictionary dictionary_;
+  std::shared_ptr<const nori::NoriTokenizer> tokenizer_;
+  std::shared_ptr<const PyDictionaries> dictionaries_;
 };
 
 PYBIND11_MODULE(bind, m) {
@@ -166,5 +266,7 @@ PYBIND11_MODULE(bind, m) {
       .def("load_prebuilt_dictionary",
            &PyNoriTokenizer::load_prebuilt_dictionary)
       .def("load_user_dictionary", &PyNoriTokenizer::load_user_dictionary)
-      .def("tokenize", &PyNoriTokenizer::tokenize);
+      .def("tokenize", &PyNoriTokenizer::tokenize)
+      .def("tokenize_batch", &PyNoriTokenizer::tokenize_batch,
+           py::arg("sentences"), py::arg("num_threads") = 0);
 }
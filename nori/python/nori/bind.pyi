@@ -20,3 +20,4 @@ class NoriTokenizer:
     def load_prebuilt_dictionary(self, filename: str): ...
     def load_user_dictionary(self, filename: str): ...
     def tokenize(self, input: str) -> Lattice: ...
+    def tokenize_batch(self, sentences: List[str], num_threads: int = 0) -> List[Lattice]: ...
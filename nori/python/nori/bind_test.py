@@ -1,4 +1,5 @@
 import unittest
+from concurrent.futures import ThreadPoolExecutor
 
 from nori.bind import NoriTokenizer
 
@@ -23,6 +24,50 @@ class TestNoriTokenizer(unittest.TestCase):
         self.assertEqual(len(result.tokens[1].expr), 2)
         self.assertEqual(result.tokens[1].expr, [('붕어', 'NNG'), ('빵', 'NNG')])
 
+    def test_share_dictionary(self):
+        tokenizer = NoriTokenizer()
+        other_tokenizer = NoriTokenizer()
+        with self.assertRaises(RuntimeError):
+            tokenizer.load_user_dictionary("./dictionary/latest-userdict.txt")
+
+        tokenizer.load_prebuilt_dictionary("./dictionary/latest-dictionary.nori")
+        other_tokenizer.load_prebuilt_dictionary("./dictionary/latest-dictionary.nori")
+        previous = other_tokenizer.tokenize("화학 이외의 것")
+        other_tokenizer.load_user_dictionary("./dictionary/latest-userdict.txt")
+        del tokenizer
+
+        result = other_tokenizer.tokenize("화학 이외의 것")
+        self.assertEqual([token.surface for token in result.tokens[1:-1]], ['화학', '이외', '의', '것'])
+
+        # tokens keep their dictionaries after the tokenizer is freed.
+        tokens = result.tokens
+        del other_tokenizer, result
+        self.assertEqual([token.postag for token in previous.tokens[1:-1]], [token.postag for token in tokens[1:-1]])
+
+    def test_tokenize_batch(self):
+        tokenizer = NoriTokenizer()
+        tokenizer.load_prebuilt_dictionary("./dictionary/latest-dictionary.nori")
+
+        sentences = ["화학 이외의 것", "붕어빵", ""] * 10
+        for num_threads in [0, 1, 4]:
+            results = tokenizer.tokenize_batch(sentences, num_threads=num_threads)
+            self.assertEqual(len(results), len(sentences))
+            for sentence, result in zip(sentences, results):
+                expected = tokenizer.tokenize(sentence)
+                self.assertEqual(result.sentence, expected.sentence)
+                self.assertEqual([token.surface for token in result.tokens], [token.surface for token in expected.tokens])
+
+        self.assertEqual(tokenizer.tokenize_batch([]), [])
+
+    def test_tokenize_threads(self):
+        tokenizer = NoriTokenizer()
+        tokenizer.load_prebuilt_dictionary("./dictionary/latest-dictionary.nori")
+
+        with ThreadPoolExecutor(max_workers=4) as executor:
+            results = list(executor.map(tokenizer.tokenize, ["화학 이외의 것"] * 100))
+        for result in results:
+            self.assertEqual([token.surface for token in result.tokens[1:-1]], ['화학', '이외', '의', '것'])
+
 
 if __name__ == "__main__":
     unittest.main()
@@ -0,0 +1,129 @@
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <tuple>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/flags/usage.h"
+#include "absl/log/check.h"
+#include "absl/log/initialize.h"
+#include "absl/log/log.h"
+#include "nori/lib/dictionary/dictionary.h"
+#include "nori/lib/tokenizer.h"
+
+ABSL_FLAG(std::string, dictionary, "./dictionary/latest-dictionary.nori",
+          "Path to nori dictionary");
+ABSL_FLAG(std::string, user_dictionary, "./dictionary/latest-userdict.txt",
+          "Path to nori user dictionary");
+ABSL_FLAG(std::string, input, "./tools/benchmark/data.txt",
+          "Text file to analyze");
+ABSL_FLAG(int, n, 1000, "n lines");
+ABSL_FLAG(int, max_entries, 100000, "max entries of the eojeol cache");
+
+namespace {
+
+typedef std::set<std::tuple<size_t, size_t, const nori::protos::Morpheme*>>
+    TokenSet;
+
+TokenSet toTokenSet(const std::vector<nori::Token>& tokens) {
+  TokenSet output;
+  for (const auto& token : tokens)
+    output.emplace(token.offset, token.length, token.morpheme);
+  return output;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  absl::SetProgramUsageMessage(
+      "Benchmark the throughput and the accuracy of the eojeol cache against "
+      "the exact tokenization");
+  absl::ParseCommandLine(argc, argv);
+
+  absl::InitializeLog();
+
+  GOOGLE_PROTOBUF_VERIFY_VERSION;
+
+  auto dictionaryFlag = absl::GetFlag(FLAGS_dictionary);
+  auto userDictionaryFlag = absl::GetFlag(FLAGS_user_dictionary);
+  auto inputFlag = absl::GetFlag(FLAGS_input);
+  auto nFlag = absl::GetFlag(FLAGS_n);
+  auto maxEntriesFlag = absl::GetFlag(FLAGS_max_entries);
+
+  nori::dictionary::Dictionary dictionary;
+  auto status = dictionary.loadPrebuilt(dictionaryFlag);
+  CHECK(status.ok()) << status.message();
+  if (userDictionaryFlag != "") {
+    status = dictionary.loadUser(userDictionaryFlag);
+    CHECK(status.ok()) << status.message();
+  }
+  nori::NoriTokenizer tokenizer(&dictionary);
+
+  std::vector<nori::Lattice> exactLattices, cachedLattices;
+  {
+    std::ifstream ifs(inputFlag);
+    CHECK(ifs.good()) << "Cannot open " << inputFlag;
+    std::string line;
+    while (exactLattices.size() < nFlag && std::getline(ifs, line)) {
+      exactLattices.emplace_back();
+      cachedLattices.emplace_back();
+      status =
+          exactLattices.back().setSentence(line, dictionary.getNormalizer());
+      CHECK(status.ok()) << status.message();
+      status =
+          cachedLattices.back().setSentence(line, dictionary.getNormalizer());
+      CHECK(status.ok()) << status.message();
+    }
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  for (auto& lattice : exactLattices) {
+    status = tokenizer.tokenize(lattice);
+    CHECK(status.ok()) << status.message();
+  }
+  const auto exactMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+
+  nori::EojeolCache cache(maxEntriesFlag);
+  start = std::chrono::steady_clock::now();
+  for (auto& lattice : cachedLattices) {
+    status = tokenizer.tokenize(lattice, cache);
+    CHECK(status.ok()) << status.message();
+  }
+  const auto cachedMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
+
+  // tokens are the same if they have the same offset, length and morpheme.
+  size_t numExactTokens = 0, numCachedTokens = 0, numCommonTokens = 0;
+  size_t numSameSentences = 0;
+  for (int i = 0; i < exactLattices.size(); i++) {
+    const auto exactTokens = toTokenSet(*exactLattices[i].getTokens());
+    const auto cachedTokens = toTokenSet(*cachedLattices[i].getTokens());
+    numExactTokens += exactTokens.size();
+    numCachedTokens += cachedTokens.size();
+    for (const auto& token : cachedTokens)
+      numCommonTokens += exactTokens.count(token);
+    if (exactTokens == cachedTokens) numSameSentences++;
+  }
+
+  const auto numLookups = cache.getNumHits() + cache.getNumMisses();
+  std::cout << "Lines: " << exactLattices.size() << std::endl;
+  std::cout << "Exact: " << exactMs << "ms" << std::endl;
+  std::cout << "Eojeol cache: " << cachedMs << "ms" << std::endl;
+  std::cout << "Cache hit rate: "
+            << (numLookups > 0 ? 100.0 * cache.getNumHits() / numLookups : 0)
+            << "%" << std::endl;
+  std::cout << "Token precision: " << 100.0 * numCommonTokens / numCachedTokens
+            << "%" << std::endl;
+  std::cout << "Token recall: " << 100.0 * numCommonTokens / numExactTokens
+            << "%" << std::endl;
+  std::cout << "Same sentences: "
+            << 100.0 * numSameSentences / exactLattices.size() << "%"
+            << std::endl;
+  google::protobuf::ShutdownProtobufLibrary();
+}
@@ -0,0 +1,96 @@
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/flags/usage.h"
+#include "absl/log/check.h"
+#include "absl/log/initialize.h"
+#include "absl/log/log.h"
+#include "icu4c/source/common/unicode/utf8.h"
+#include "nori/lib/dictionary/dictionary.h"
+
+ABSL_FLAG(std::string, dictionary, "./dictionary/latest-dictionary.nori",
+          "Path to nori dictionary built with --aho_corasick");
+ABSL_FLAG(std::string, input, "./tools/benchmark/data.txt",
+          "Text file to analyze");
+ABSL_FLAG(int, n, 1000, "n lines");
+ABSL_FLAG(int, repeat, 10, "number of passes over the lines");
+
+int main(int argc, char** argv) {
+  absl::SetProgramUsageMessage(
+      "Benchmark lexicon matchers: the trie searched from every character and "
+      "the Aho-Corasick automaton over whole lines");
+  absl::ParseCommandLine(argc, argv);
+
+  absl::InitializeLog();
+
+  GOOGLE_PROTOBUF_VERIFY_VERSION;
+
+  auto dictionaryFlag = absl::GetFlag(FLAGS_dictionary);
+  auto inputFlag = absl::GetFlag(FLAGS_input);
+  auto nFlag = absl::GetFlag(FLAGS_n);
+  auto repeatFlag = absl::GetFlag(FLAGS_repeat);
+
+  nori::dictionary::Dictionary dictionary;
+  auto status = dictionary.loadPrebuilt(dictionaryFlag);
+  CHECK(status.ok()) << status.message();
+  const auto* ahoCorasick = dictionary.getAhoCorasick();
+  CHECK(ahoCorasick != nullptr)
+      << dictionaryFlag << " is built without --aho_corasick";
+
+  std::vector<std::string> lines;
+  {
+    std::ifstream ifs(inputFlag);
+    CHECK(ifs.good()) << "Cannot open " << inputFlag;
+    std::string line;
+    while (lines.size() < nFlag && std::getline(ifs, line)) {
+      std::string normalized;
+      status = dictionary.getNormalizer()->normalize(line, normalized);
+      CHECK(status.ok()) << status.message();
+      lines.push_back(normalized);
+    }
+  }
+
+  std::vector<Darts::DoubleArray::result_pair_type> results(1024);
+  size_t numTrieMatches = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < repeatFlag; i++) {
+    for (const auto& line : lines) {
+      const char* begin = line.data();
+      const char* end = begin + line.size();
+      for (int offset = 0; offset < line.size();) {
+        numTrieMatches += dictionary.commonPrefixSearch(
+            begin + offset, end, results.data(), results.size());
+        U8_FWD_1_UNSAFE(begin, offset);
+      }
+    }
+  }
+  const auto trieMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+
+  size_t numAhoCorasickMatches = 0;
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < repeatFlag; i++) {
+    for (const auto& line : lines) {
+      ahoCorasick->match(line, [&](size_t offset, int length, int value) {
+        numAhoCorasickMatches++;
+      });
+    }
+  }
+  const auto ahoCorasickMs =
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::steady_clock::now() - start)
+          .count();
+
+  // Both matchers find all terms that start at the boundaries of characters.
+  CHECK_EQ(numTrieMatches, numAhoCorasickMatches);
+
+  std::cout << "Matches: " << numTrieMatches << std::endl;
+  std::cout << "Trie: " << trieMs << "ms" << std::endl;
+  std::cout << "Aho-Corasick: " << ahoCorasickMs << "ms" << std::endl;
+  google::protobuf::ShutdownProtobufLibrary();
+}